@@ -0,0 +1,260 @@
+#ifndef CARR_ARENA_H_
+#define CARR_ARENA_H_
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// A bump allocator: memory is handed out from big blocks by moving a
+// pointer forward, and it is given back all at once, either entirely with
+// carr_arena_clear or back to a point saved with carr_arena_mark.
+// Every allocation is preceded by its size, so carr_arena_realloc does not
+// need the old size, and growing the most recent allocation (the usual
+// case for a vec or a string builder being filled) happens in place.
+//
+// vec.h, sv.h, map.h and omap.h allocate through the CARR_MALLOC,
+// CARR_REALLOC and CARR_FREE macros, so they can be pointed to an arena:
+//
+//     #define CARR_MALLOC(n)     carr_arena_hook_malloc(n)
+//     #define CARR_REALLOC(p, n) carr_arena_hook_realloc((p), (n))
+//     #define CARR_FREE(p)       carr_arena_hook_free(p)
+//     #include "arena.h"
+//     #include "vec.h"
+//
+// The hooks allocate from carr_arena_current, which is per thread and must
+// be set before any container allocates. All the containers built while it
+// is set are then released by a single reset, without freeing them one by
+// one (and using them after that reset is an error).
+
+// The user can define this macro to include only the functions
+// with the 'carr_' prefix, as to avoid name collisions.
+// If this macro is not defined, all the versions without prefix
+// will also be included by default.
+#ifndef CARR_ARENA_FORCE_PREFIX
+
+#define Arena         CarrArena
+#define ArenaMark     CarrArenaMark
+#define arena_init    carr_arena_init
+#define arena_free    carr_arena_free
+#define arena_alloc   carr_arena_alloc
+#define arena_realloc carr_arena_realloc
+#define arena_pop     carr_arena_pop
+#define arena_mark    carr_arena_mark
+#define arena_reset   carr_arena_reset
+#define arena_clear   carr_arena_clear
+
+#endif // CARR_ARENA_FORCE_PREFIX
+
+#ifndef CARR_ARENA_BLOCK_SIZE
+#define CARR_ARENA_BLOCK_SIZE (64 * 1024)
+#endif // CARR_ARENA_BLOCK_SIZE
+
+// Every allocation is aligned to this, which is enough for any type.
+#define CARR_ARENA_ALIGN 16
+
+typedef struct CarrArenaBlock {
+    struct CarrArenaBlock* prev;
+    size_t                 cap;
+    size_t                 used;
+    _Alignas(CARR_ARENA_ALIGN) uint8_t data[];
+} CarrArenaBlock;
+
+typedef struct {
+    CarrArenaBlock* head;
+    // Blocks released by a reset, kept to be reused.
+    CarrArenaBlock* spare;
+    size_t          block_size;
+    // The most recent allocation, the only one that can grow in place.
+    void*           last;
+} CarrArena;
+
+typedef struct {
+    CarrArenaBlock* block;
+    size_t          used;
+} CarrArenaMark;
+
+// block_size is the minimum size of the blocks, 0 means
+// CARR_ARENA_BLOCK_SIZE. Bigger allocations get a block of their own.
+void  carr_arena_init(CarrArena* a, size_t block_size);
+// Gives all the blocks back to the system.
+void  carr_arena_free(CarrArena* a);
+
+void* carr_arena_alloc(CarrArena* a, size_t n);
+// Like realloc, p can be NULL. The contents are moved only when p is not
+// the most recent allocation or there is no room left after it.
+void* carr_arena_realloc(CarrArena* a, void* p, size_t n);
+// Gives p back if it is the most recent allocation, does nothing otherwise.
+void  carr_arena_pop(CarrArena* a, void* p);
+
+CarrArenaMark carr_arena_mark(CarrArena* a);
+// Releases everything allocated after mark was taken.
+void          carr_arena_reset(CarrArena* a, CarrArenaMark mark);
+// Releases everything, keeping the blocks for the next allocations.
+void          carr_arena_clear(CarrArena* a);
+
+// Allocation hooks on the arena of the current thread, see above.
+extern _Thread_local CarrArena* carr_arena_current;
+void* carr_arena_hook_malloc(size_t n);
+void* carr_arena_hook_realloc(void* p, size_t n);
+void  carr_arena_hook_free(void* p);
+
+#ifdef CARR_ARENA_IMPLEMENTATION
+
+_Thread_local CarrArena* carr_arena_current = NULL;
+
+size_t _carr_arena_align(size_t n)
+{
+    return (n + CARR_ARENA_ALIGN - 1) & ~(size_t)(CARR_ARENA_ALIGN - 1);
+}
+
+// The size of an allocation lives in the CARR_ARENA_ALIGN bytes before it.
+size_t* _carr_arena_size_of(void* p)
+{
+    return (size_t*)((uint8_t*)p - CARR_ARENA_ALIGN);
+}
+
+void carr_arena_init(CarrArena* a, size_t block_size)
+{
+    *a = (CarrArena){0};
+    a->block_size = block_size > 0 ? block_size : CARR_ARENA_BLOCK_SIZE;
+}
+
+void _carr_arena_free_list(CarrArenaBlock* b)
+{
+    while (b != NULL) {
+        CarrArenaBlock* prev = b->prev;
+        free(b);
+        b = prev;
+    }
+}
+
+void carr_arena_free(CarrArena* a)
+{
+    _carr_arena_free_list(a->head);
+    _carr_arena_free_list(a->spare);
+    *a = (CarrArena){0};
+}
+
+// Makes head a block with at least need bytes free, reusing a spare block
+// if one is big enough.
+void _carr_arena_new_block(CarrArena* a, size_t need)
+{
+    CarrArenaBlock** link = &a->spare;
+    while (*link != NULL && (*link)->cap < need) {
+        link = &(*link)->prev;
+    }
+
+    CarrArenaBlock* b = *link;
+    if (b != NULL) {
+        *link = b->prev;
+    } else {
+        size_t cap = need > a->block_size ? need : a->block_size;
+        b = (CarrArenaBlock*)malloc(sizeof(CarrArenaBlock) + cap);
+        b->cap = cap;
+    }
+    b->used = 0;
+    b->prev = a->head;
+    a->head = b;
+}
+
+void* carr_arena_alloc(CarrArena* a, size_t n)
+{
+    size_t need = CARR_ARENA_ALIGN + _carr_arena_align(n);
+    if (a->head == NULL || a->head->cap - a->head->used < need) {
+        _carr_arena_new_block(a, need);
+    }
+
+    uint8_t* p = a->head->data + a->head->used + CARR_ARENA_ALIGN;
+    a->head->used += need;
+    *_carr_arena_size_of(p) = n;
+    a->last = p;
+    return p;
+}
+
+void* carr_arena_realloc(CarrArena* a, void* p, size_t n)
+{
+    if (p == NULL) {
+        return carr_arena_alloc(a, n);
+    }
+
+    size_t old = *_carr_arena_size_of(p);
+    if (p == a->last) {
+        // The allocation ends where the free space of head starts.
+        size_t start = (uint8_t*)p - a->head->data;
+        size_t end   = start + _carr_arena_align(n);
+        if (end <= a->head->cap) {
+            a->head->used = end;
+            *_carr_arena_size_of(p) = n;
+            return p;
+        }
+    } else if (n <= old) {
+        *_carr_arena_size_of(p) = n;
+        return p;
+    }
+
+    void* q = carr_arena_alloc(a, n);
+    memcpy(q, p, old < n ? old : n);
+    return q;
+}
+
+void carr_arena_pop(CarrArena* a, void* p)
+{
+    if (p == NULL || p != a->last) {
+        return;
+    }
+    a->head->used = (uint8_t*)p - a->head->data - CARR_ARENA_ALIGN;
+    a->last = NULL;
+}
+
+CarrArenaMark carr_arena_mark(CarrArena* a)
+{
+    return (CarrArenaMark){
+        .block = a->head,
+        .used  = a->head != NULL ? a->head->used : 0,
+    };
+}
+
+void carr_arena_reset(CarrArena* a, CarrArenaMark mark)
+{
+    while (a->head != mark.block) {
+        assert(a->head != NULL && "mark does not belong to this arena");
+        CarrArenaBlock* b = a->head;
+        a->head  = b->prev;
+        b->prev  = a->spare;
+        a->spare = b;
+    }
+    if (a->head != NULL) {
+        a->head->used = mark.used;
+    }
+    a->last = NULL;
+}
+
+void carr_arena_clear(CarrArena* a)
+{
+    carr_arena_reset(a, (CarrArenaMark){0});
+}
+
+void* carr_arena_hook_malloc(size_t n)
+{
+    assert(carr_arena_current != NULL && "carr_arena_current is not set");
+    return carr_arena_alloc(carr_arena_current, n);
+}
+
+void* carr_arena_hook_realloc(void* p, size_t n)
+{
+    assert(carr_arena_current != NULL && "carr_arena_current is not set");
+    return carr_arena_realloc(carr_arena_current, p, n);
+}
+
+void carr_arena_hook_free(void* p)
+{
+    if (carr_arena_current != NULL) {
+        carr_arena_pop(carr_arena_current, p);
+    }
+}
+
+#endif // CARR_ARENA_IMPLEMENTATION
+
+#endif // CARR_ARENA_H_
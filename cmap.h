@@ -0,0 +1,188 @@
+#ifndef CARR_CMAP_H_
+#define CARR_CMAP_H_
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "map.h"
+
+// A Map that can be shared between threads. It is split in shards, each
+// one a regular Map with its own lock, so threads working on keys of
+// different shards never wait for each other. The shard of a key is
+// picked by the high bits of its hash while the Map inside the shard
+// uses the low ones, so every operation hashes the key only once.
+// As for map.h, exactly one file must define CARR_MAP_IMPLEMENTATION
+// (and CARR_CMAP_IMPLEMENTATION) before including this file.
+// The file [examples/13-word_counter_threads.c] provides a complete example.
+
+// The user can define this macro to include only the functions
+// with the 'carr_' prefix, as to avoid name collisions.
+// If this macro is not defined, all the versions without prefix
+// will also be included by default.
+#ifndef CARR_CMAP_FORCE_PREFIX
+
+#define CMap           CarrCMap
+#define cmap_init      carr_cmap_init
+#define cmap_free      carr_cmap_free
+#define cmap_len       carr_cmap_len
+#define cmap_nget      carr_cmap_nget
+#define cmap_ninsert   carr_cmap_ninsert
+#define cmap_ndelete   carr_cmap_ndelete
+#define cmap_nadd      carr_cmap_nadd
+#define cmap_get_sv    carr_cmap_get_sv
+#define cmap_insert_sv carr_cmap_insert_sv
+#define cmap_delete_sv carr_cmap_delete_sv
+#define cmap_add_sv    carr_cmap_add_sv
+
+#endif // CARR_CMAP_FORCE_PREFIX
+
+#ifndef CARR_CMAP_DEFAULT_SHARDS
+#define CARR_CMAP_DEFAULT_SHARDS 64
+#endif // CARR_CMAP_DEFAULT_SHARDS
+
+// Every shard starts on its own cache line, so two threads taking the
+// locks of two different shards do not fight over the same line.
+#ifndef CARR_CMAP_CACHE_LINE
+#define CARR_CMAP_CACHE_LINE 64
+#endif // CARR_CMAP_CACHE_LINE
+
+typedef struct {
+    _Alignas(CARR_CMAP_CACHE_LINE) pthread_mutex_t lock;
+    Map map;
+} CarrCMapShard;
+
+typedef struct {
+    CarrCMapShard* shards;
+    size_t         n_shards;
+    unsigned       shard_bits;
+} CarrCMap;
+
+// n_shards is rounded up to a power of two, 0 means
+// CARR_CMAP_DEFAULT_SHARDS. A few times the number of threads is a good
+// starting point.
+void   carr_cmap_init(CarrCMap* m, size_t n_shards);
+void   carr_cmap_free(CarrCMap* m);
+// Total number of entries. Only exact when no other thread is writing.
+size_t carr_cmap_len(CarrCMap* m);
+
+// These behave like their carr_map_n* counterparts, including the key
+// being copied when it is inserted. The entry copied out by nget stays
+// valid as long as the key is not deleted by another thread.
+void carr_cmap_nget(CarrCMap* m, const char* key, size_t n, Entry* e);
+void carr_cmap_ninsert(CarrCMap* m, const char* key, size_t n, void* value);
+void carr_cmap_ndelete(CarrCMap* m, const char* key, size_t n);
+
+// Treats the value of key as an intptr_t counter (a missing key counts
+// as 0), atomically adds delta to it and returns the new count.
+intptr_t carr_cmap_nadd(CarrCMap* m, const char* key, size_t n, intptr_t delta);
+
+#define carr_cmap_get_sv(m, sv, e)                                             \
+    carr_cmap_nget((m), (sv).data, (sv).len, (e))
+#define carr_cmap_insert_sv(m, sv, value)                                      \
+    carr_cmap_ninsert((m), (sv).data, (sv).len, (value))
+#define carr_cmap_delete_sv(m, sv)                                             \
+    carr_cmap_ndelete((m), (sv).data, (sv).len)
+#define carr_cmap_add_sv(m, sv, delta)                                         \
+    carr_cmap_nadd((m), (sv).data, (sv).len, (delta))
+
+#ifdef CARR_CMAP_IMPLEMENTATION
+
+void carr_cmap_init(CarrCMap* m, size_t n_shards)
+{
+    if (n_shards == 0) {
+        n_shards = CARR_CMAP_DEFAULT_SHARDS;
+    }
+    m->n_shards   = 1;
+    m->shard_bits = 0;
+    while (m->n_shards < n_shards) {
+        m->n_shards <<= 1;
+        m->shard_bits++;
+    }
+
+    m->shards = (CarrCMapShard*)aligned_alloc(
+        CARR_CMAP_CACHE_LINE, m->n_shards * sizeof(m->shards[0])
+    );
+    for (size_t i = 0; i < m->n_shards; ++i) {
+        pthread_mutex_init(&m->shards[i].lock, NULL);
+        carr_map_init(&m->shards[i].map);
+    }
+}
+
+void carr_cmap_free(CarrCMap* m)
+{
+    for (size_t i = 0; i < m->n_shards; ++i) {
+        pthread_mutex_destroy(&m->shards[i].lock);
+        carr_map_free(&m->shards[i].map);
+    }
+    free(m->shards);
+    *m = (CarrCMap){0};
+}
+
+size_t carr_cmap_len(CarrCMap* m)
+{
+    size_t len = 0;
+    for (size_t i = 0; i < m->n_shards; ++i) {
+        pthread_mutex_lock(&m->shards[i].lock);
+        len += m->shards[i].map.len;
+        pthread_mutex_unlock(&m->shards[i].lock);
+    }
+    return len;
+}
+
+CarrCMapShard* _carr_cmap_shard(CarrCMap* m, uint64_t hash)
+{
+    if (m->shard_bits == 0) {
+        return &m->shards[0];
+    }
+    return &m->shards[hash >> (64 - m->shard_bits)];
+}
+
+void carr_cmap_nget(CarrCMap* m, const char* key, size_t n, Entry* e)
+{
+    uint64_t       hash  = CARR_MAP_HASH(key, n);
+    CarrCMapShard* shard = _carr_cmap_shard(m, hash);
+
+    pthread_mutex_lock(&shard->lock);
+    carr_map_hget(&shard->map, key, n, hash, e);
+    pthread_mutex_unlock(&shard->lock);
+}
+
+void carr_cmap_ninsert(CarrCMap* m, const char* key, size_t n, void* value)
+{
+    uint64_t       hash  = CARR_MAP_HASH(key, n);
+    CarrCMapShard* shard = _carr_cmap_shard(m, hash);
+
+    pthread_mutex_lock(&shard->lock);
+    *carr_map_hupsert(&shard->map, key, n, hash) = value;
+    pthread_mutex_unlock(&shard->lock);
+}
+
+void carr_cmap_ndelete(CarrCMap* m, const char* key, size_t n)
+{
+    uint64_t       hash  = CARR_MAP_HASH(key, n);
+    CarrCMapShard* shard = _carr_cmap_shard(m, hash);
+
+    pthread_mutex_lock(&shard->lock);
+    carr_map_hdelete(&shard->map, key, n, hash);
+    pthread_mutex_unlock(&shard->lock);
+}
+
+intptr_t carr_cmap_nadd(CarrCMap* m, const char* key, size_t n, intptr_t delta)
+{
+    uint64_t       hash  = CARR_MAP_HASH(key, n);
+    CarrCMapShard* shard = _carr_cmap_shard(m, hash);
+
+    pthread_mutex_lock(&shard->lock);
+    void**   slot  = carr_map_hupsert(&shard->map, key, n, hash);
+    intptr_t count = (intptr_t)*slot + delta;
+    *slot = (void*)count;
+    pthread_mutex_unlock(&shard->lock);
+    return count;
+}
+
+#endif // CARR_CMAP_IMPLEMENTATION
+
+#endif // CARR_CMAP_H_
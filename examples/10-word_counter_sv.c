@@ -20,22 +20,13 @@ int main(void)
             StringView word = sv_chop_by_space(&line_view);
             sv_strip_space(&word);
 
-            Entry item;
-            int* count = malloc(sizeof(int));
-            char* key = sv_to_cstr(word);
-
-            map_get(&freqs, key, &item);
-            if (item.key == NULL && item.value == NULL) {
-                *count = 1;
-            } else {
-                *count = *(int*)item.value + 1;
+            // Upserting with the view itself walks the table once per
+            // word, and only copies the word the first time it is seen.
+            void** count = map_upsert_sv(&freqs, word);
+            if (*count == NULL) {
+                *count = calloc(1, sizeof(int));
             }
-
-            item = (Entry) {
-                .key   = key,
-                .value = (void*)count,
-            };
-            map_insert(&freqs, item);
+            *(int*)*count += 1;
         };
     }
 
@@ -0,0 +1,106 @@
+// Keeps a map at a steady, high load while constantly deleting the
+// oldest keys and inserting new ones, and reports how long the probe
+// sequences are after each round. Tombstones make lookups of missing keys
+// walk further and further; with the cleanup in map.h the number of
+// groups they walk should stay bounded.
+#include <stdio.h>
+#include <time.h>
+
+#define CARR_MAP_IMPLEMENTATION
+#include "../map.h"
+
+#define LIVE_KEYS 130000
+#define BATCH     20000
+#define ROUNDS    40
+#define RING      (LIVE_KEYS + BATCH)
+#define KEY_SIZE  24
+
+char keys[RING][KEY_SIZE];
+
+double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Average number of groups a successful lookup walks.
+double avg_hit_groups(Map* m)
+{
+    size_t total = 0;
+    for (size_t i = 0; i < m->cap; ++i) {
+        if (m->items[i].key == NULL) {
+            continue;
+        }
+        size_t home = (m->hashes[i] >> 7) & (m->cap - 1);
+        total += ((i - home) & (m->cap - 1)) / 16 + 1;
+    }
+    return (double)total / m->len;
+}
+
+// Average number of groups a lookup of a missing key walks, which is
+// the distance from its home slot to the first group with an empty slot.
+double avg_miss_groups(Map* m)
+{
+    size_t total = 0;
+    for (size_t home = 0; home < m->cap; ++home) {
+        size_t pos = home;
+        for (;;) {
+            total++;
+            bool has_empty = false;
+            for (size_t i = 0; i < 16; ++i) {
+                has_empty |= m->ctrl[pos + i] == 0x80;
+            }
+            if (has_empty) {
+                break;
+            }
+            pos = (pos + 16) & (m->cap - 1);
+        }
+    }
+    return (double)total / m->cap;
+}
+
+void make_key(size_t id)
+{
+    snprintf(keys[id % RING], KEY_SIZE, "key-%zu", id);
+}
+
+int main(void)
+{
+    Map m;
+    map_init(&m);
+
+    size_t next = 0;
+    for (; next < LIVE_KEYS; ++next) {
+        make_key(next);
+        map_insert(&m, (Entry){ keys[next % RING], (void*)next });
+    }
+
+    printf("round |    len |     cap | tombstones | hit groups | miss groups | ns/get\n");
+    for (int round = 0; round < ROUNDS; ++round) {
+        for (size_t i = 0; i < BATCH; ++i, ++next) {
+            map_delete(&m, keys[(next - LIVE_KEYS) % RING]);
+            make_key(next);
+            map_insert(&m, (Entry){ keys[next % RING], (void*)next });
+        }
+
+        double start = now_ns();
+        size_t hits  = 0;
+        for (size_t i = next - LIVE_KEYS; i < next; ++i) {
+            Entry e;
+            map_get(&m, keys[i % RING], &e);
+            hits += e.key != NULL;
+        }
+        double ns = (now_ns() - start) / LIVE_KEYS;
+
+        printf(
+            "%5d | %6zu | %7zu | %10zu | %10.3f | %11.3f | %6.1f%s\n",
+            round, m.len, m.cap, m.tombstones,
+            avg_hit_groups(&m), avg_miss_groups(&m), ns,
+            hits == LIVE_KEYS ? "" : " (missing keys!)"
+        );
+    }
+
+    map_free(&m);
+    return 0;
+}
@@ -0,0 +1,42 @@
+#include <stdio.h>
+
+#define CARR_MAP_IMPLEMENTATION
+#include "../map.h"
+
+#define CARR_SV_IMPLEMENTATION
+#include "../sv.h"
+
+// A map from StringView to int: the counters live inside the slots and
+// the keys point into the file buffer, so counting a word never allocates.
+CARR_MAP_DEFINE(WordCount, StringView, int, carr_map_sv_hash, carr_map_sv_eq)
+
+int main(void)
+{
+    WordCount freqs;
+    WordCount_init(&freqs);
+
+    StringBuilder buf = sb_from_file("examples/fpessoa.txt");
+    StringView file_view = sv_from_sb(buf);
+
+    while (file_view.len > 0) {
+        StringView line_view = sv_chop_line(&file_view);
+        while (line_view.len > 0) {
+            StringView word = sv_chop_by_space(&line_view);
+            sv_strip_space(&word);
+
+            *WordCount_upsert(&freqs, word) += 1;
+        };
+    }
+
+    for (size_t i = 0; i < freqs.cap; ++i) {
+        if (!carr_map_slot_full(&freqs, i)) {
+            continue;
+        }
+        WordCountItem item = freqs.items[i];
+        printf("%.*s: %d\n", (int)item.key.len, item.key.data, item.value);
+    }
+
+    WordCount_free(&freqs);
+    sb_free(&buf);
+    return 0;
+}
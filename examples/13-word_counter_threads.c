@@ -0,0 +1,120 @@
+// Counts the words of a big corpus (examples/fpessoa.txt repeated
+// REPEAT times) with 1 to N threads sharing a single CMap, and prints
+// how the throughput scales with the number of threads.
+// Usage: 13-word_counter_threads [max_threads]
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CARR_MAP_IMPLEMENTATION
+#define CARR_CMAP_IMPLEMENTATION
+#include "../cmap.h"
+
+#define CARR_SV_IMPLEMENTATION
+#include "../sv.h"
+
+#define REPEAT 100
+
+typedef struct {
+    CMap*      freqs;
+    StringView text;
+    size_t     words;
+} Job;
+
+double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void* count_words(void* arg)
+{
+    Job* job = (Job*)arg;
+    while (job->text.len > 0) {
+        StringView line_view = sv_chop_line(&job->text);
+        while (line_view.len > 0) {
+            StringView word = sv_chop_by_space(&line_view);
+            sv_strip_space(&word);
+            cmap_add_sv(job->freqs, word, 1);
+            job->words++;
+        }
+    }
+    return NULL;
+}
+
+// Splits text in n_jobs slices of about the same size, cutting only at
+// line breaks.
+void split_text(StringView text, Job* jobs, size_t n_jobs)
+{
+    size_t start = 0;
+    for (size_t i = 0; i < n_jobs; ++i) {
+        size_t end = (i + 1 == n_jobs) ? text.len : text.len * (i + 1) / n_jobs;
+        while (end < text.len && text.data[end] != '\n') {
+            end++;
+        }
+        if (end < start) {
+            end = start;
+        }
+        jobs[i].text = (StringView){ text.data + start, end - start };
+        start = end;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    size_t max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (argc > 1) {
+        max_threads = (size_t)atoi(argv[1]);
+    }
+    if (max_threads == 0) {
+        max_threads = 1;
+    }
+
+    StringBuilder file = sb_from_file("examples/fpessoa.txt");
+    StringBuilder corpus = sb_new();
+    for (int i = 0; i < REPEAT; ++i) {
+        sb_nconcat(&corpus, file.data, file.len);
+        sb_append(&corpus, '\n');
+    }
+    StringView text = sv_from_sb(corpus);
+
+    printf("threads | seconds | Mwords/s | speedup | unique words\n");
+    double base = 0;
+    for (size_t n_threads = 1; n_threads <= max_threads; n_threads *= 2) {
+        CMap freqs;
+        cmap_init(&freqs, n_threads * 16);
+
+        Job*       jobs    = calloc(n_threads, sizeof(Job));
+        pthread_t* threads = calloc(n_threads, sizeof(pthread_t));
+        split_text(text, jobs, n_threads);
+
+        double start = now_s();
+        for (size_t i = 0; i < n_threads; ++i) {
+            jobs[i].freqs = &freqs;
+            pthread_create(&threads[i], NULL, count_words, &jobs[i]);
+        }
+        size_t words = 0;
+        for (size_t i = 0; i < n_threads; ++i) {
+            pthread_join(threads[i], NULL);
+            words += jobs[i].words;
+        }
+        double secs = now_s() - start;
+        if (n_threads == 1) {
+            base = secs;
+        }
+
+        printf(
+            "%7zu | %7.3f | %8.2f | %6.2fx | %zu\n",
+            n_threads, secs, words / secs / 1e6, base / secs, cmap_len(&freqs)
+        );
+
+        free(jobs);
+        free(threads);
+        cmap_free(&freqs);
+    }
+
+    sb_free(&corpus);
+    sb_free(&file);
+    return 0;
+}
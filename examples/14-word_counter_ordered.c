@@ -0,0 +1,42 @@
+#include <stdio.h>
+
+#define CARR_MAP_IMPLEMENTATION
+#define CARR_OMAP_IMPLEMENTATION
+#include "../omap.h"
+
+#define CARR_SV_IMPLEMENTATION
+#include "../sv.h"
+
+int main(void)
+{
+    OMap freqs;
+    omap_init(&freqs);
+
+    StringBuilder buf = sb_from_file("examples/fpessoa.txt");
+    StringView file_view = sv_from_sb(buf);
+
+    while (file_view.len > 0) {
+        StringView line_view = sv_chop_line(&file_view);
+        while (line_view.len > 0) {
+            StringView word = sv_chop_by_space(&line_view);
+            sv_strip_space(&word);
+
+            void** count = omap_upsert_sv(&freqs, word);
+            *count = (void*)((intptr_t)*count + 1);
+        };
+    }
+
+    // The words come out in the order they first appear in the text, and
+    // the loop only visits the len entries that were inserted.
+    for (size_t i = 0; i < freqs.len; ++i) {
+        OMapEntry item = freqs.items[i];
+        if (item.key == NULL) {
+            continue;
+        }
+        printf("%s: %d\n", item.key, (int)(intptr_t)item.value);
+    }
+
+    omap_free(&freqs);
+    sb_free(&buf);
+    return 0;
+}
@@ -0,0 +1,109 @@
+// Counts the words of examples/fpessoa.txt, freezes the counts into a
+// file, maps that file back and checks every word against it, timing
+// the lookups of the frozen map against the ones of the Map it came from.
+// Usage: 15-frozen_map [path]
+#include <stdio.h>
+#include <time.h>
+
+#define CARR_MAP_IMPLEMENTATION
+#define CARR_FMAP_IMPLEMENTATION
+#include "../fmap.h"
+
+#define CARR_SV_IMPLEMENTATION
+#include "../sv.h"
+
+#define ROUNDS 50
+
+double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char** argv)
+{
+    const char* path = argc > 1 ? argv[1] : "/tmp/fpessoa.fmap";
+
+    Map freqs;
+    map_init(&freqs);
+
+    StringBuilder buf = sb_from_file("examples/fpessoa.txt");
+    StringView file_view = sv_from_sb(buf);
+    while (file_view.len > 0) {
+        StringView line_view = sv_chop_line(&file_view);
+        while (line_view.len > 0) {
+            StringView word = sv_chop_by_space(&line_view);
+            sv_strip_space(&word);
+
+            void** count = map_upsert_sv(&freqs, word);
+            *count = (void*)((intptr_t)*count + 1);
+        }
+    }
+
+    // The counts are stored as the value pointers themselves.
+    if (!fmap_freeze(&freqs, path, 0)) {
+        return 1;
+    }
+
+    FMap frozen;
+    if (!fmap_open(&frozen, path)) {
+        return 1;
+    }
+    printf("%zu words frozen into %zu bytes\n", freqs.len, frozen.size);
+
+    size_t mismatches = 0;
+    for (size_t i = 0; i < freqs.cap; ++i) {
+        if (!carr_map_slot_full(&freqs, i)) {
+            continue;
+        }
+        const uint64_t* count = fmap_get(&frozen, freqs.items[i].key);
+        if (count == NULL || *count != (uint64_t)(intptr_t)freqs.items[i].value) {
+            mismatches++;
+        }
+    }
+    if (fmap_get(&frozen, "not a word of the text") != NULL) {
+        mismatches++;
+    }
+    printf("%zu mismatches\n", mismatches);
+
+    // Look up every word of the text again, in both maps.
+    uint64_t total = 0;
+    double start = now_s();
+    for (int r = 0; r < ROUNDS; ++r) {
+        file_view = sv_from_sb(buf);
+        while (file_view.len > 0) {
+            StringView line_view = sv_chop_line(&file_view);
+            while (line_view.len > 0) {
+                StringView word = sv_chop_by_space(&line_view);
+                sv_strip_space(&word);
+                Entry e;
+                map_get_sv(&freqs, word, &e);
+                total += (uint64_t)(intptr_t)e.value;
+            }
+        }
+    }
+    double map_secs = now_s() - start;
+
+    start = now_s();
+    for (int r = 0; r < ROUNDS; ++r) {
+        file_view = sv_from_sb(buf);
+        while (file_view.len > 0) {
+            StringView line_view = sv_chop_line(&file_view);
+            while (line_view.len > 0) {
+                StringView word = sv_chop_by_space(&line_view);
+                sv_strip_space(&word);
+                const uint64_t* count = fmap_get_sv(&frozen, word);
+                total -= *count;
+            }
+        }
+    }
+    double fmap_secs = now_s() - start;
+
+    printf("map:  %.3fs\nfmap: %.3fs\n", map_secs, fmap_secs);
+
+    fmap_close(&frozen);
+    map_free(&freqs);
+    sb_free(&buf);
+    return total != 0 || mismatches != 0;
+}
@@ -0,0 +1,110 @@
+// Simulates a server handling REQUESTS requests, each one building a few
+// small vecs, string builders and maps that only live until the request
+// is answered. All of them allocate from one arena, which is reset once
+// per request instead of freeing every container on its own.
+// Build with -DUSE_MALLOC to compare against the plain libc allocator.
+#include <stdio.h>
+#include <time.h>
+
+#ifndef USE_MALLOC
+#define CARR_MALLOC(n)     carr_arena_hook_malloc(n)
+#define CARR_REALLOC(p, n) carr_arena_hook_realloc((p), (n))
+#define CARR_FREE(p)       carr_arena_hook_free(p)
+#endif // USE_MALLOC
+
+#define CARR_ARENA_IMPLEMENTATION
+#include "../arena.h"
+
+#include "../vec.h"
+
+#define CARR_MAP_IMPLEMENTATION
+#include "../map.h"
+
+#define CARR_SV_IMPLEMENTATION
+#include "../sv.h"
+
+#define REQUESTS 20000
+#define FIELDS   40
+
+typedef struct {
+    size_t* items;
+    size_t  len;
+    size_t  cap;
+} Sizes;
+
+double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Parses a fake query string into a map, collects the lengths of the
+// values and renders a response. Returns the length of the response.
+size_t handle_request(size_t id)
+{
+    StringBuilder query = sb_new();
+    for (size_t i = 0; i < FIELDS; ++i) {
+        char field[64];
+        int n = snprintf(field, sizeof(field), "field%zu=value%zu&", i, id * i);
+        sb_nconcat(&query, field, n);
+    }
+
+    Map params;
+    map_init(&params);
+    Sizes lens;
+    vec_init(&lens);
+
+    StringView rest = sv_from_sb(query);
+    while (rest.len > 0) {
+        StringView pair = sv_chop_by_delim(&rest, '&');
+        StringView key  = sv_chop_by_delim(&pair, '=');
+        *map_upsert_sv(&params, key) = (void*)pair.data;
+        vec_append(&lens, pair.len);
+    }
+
+    StringBuilder response = sb_new();
+    for (size_t i = 0; i < lens.len; ++i) {
+        char line[32];
+        int n = snprintf(line, sizeof(line), "%zu\n", lens.items[i]);
+        sb_nconcat(&response, line, n);
+    }
+    size_t len = response.len;
+
+#ifdef USE_MALLOC
+    // Without an arena every container must be freed on its own (the map
+    // frees the keys it copied).
+    map_free(&params);
+    vec_free(&lens);
+    sb_free(&query);
+    sb_free(&response);
+#endif // USE_MALLOC
+    return len;
+}
+
+int main(void)
+{
+    Arena arena;
+    arena_init(&arena, 0);
+    carr_arena_current = &arena;
+
+    size_t total = 0;
+    double start = now_s();
+    for (size_t id = 0; id < REQUESTS; ++id) {
+        ArenaMark mark = arena_mark(&arena);
+        total += handle_request(id);
+        arena_reset(&arena, mark);
+    }
+    double secs = now_s() - start;
+
+#ifdef USE_MALLOC
+    printf("malloc: ");
+#else
+    printf("arena:  ");
+#endif // USE_MALLOC
+    printf("%d requests in %.3fs (%zu bytes of responses)\n", REQUESTS, secs, total);
+
+    carr_arena_current = NULL;
+    arena_free(&arena);
+    return 0;
+}
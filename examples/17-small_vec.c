@@ -0,0 +1,80 @@
+// Builds the adjacency lists of a random graph where most nodes have
+// only a few neighbours, once with regular vecs and once with small vecs
+// that keep up to 8 neighbours inline, and compares the time and the
+// heap memory both take.
+#include <stdio.h>
+#include <time.h>
+
+#include "../vec.h"
+
+#define NODES     50000
+#define MAX_EDGES 12
+
+typedef struct {
+    size_t* items;
+    size_t  len;
+    size_t  cap;
+} Edges;
+
+CARR_SMALL_VEC_DEFINE(SmallEdges, size_t, 8);
+
+double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(void)
+{
+    srand(42);
+    size_t* degree = malloc(NODES * sizeof(size_t));
+    for (size_t i = 0; i < NODES; ++i) {
+        degree[i] = rand() % MAX_EDGES;
+    }
+
+    double start = now_s();
+    Edges* graph = malloc(NODES * sizeof(Edges));
+    size_t heap  = 0;
+    for (size_t i = 0; i < NODES; ++i) {
+        vec_init(&graph[i]);
+        for (size_t j = 0; j < degree[i]; ++j) {
+            vec_append(&graph[i], (i + j + 1) % NODES);
+        }
+        heap += graph[i].cap * sizeof(size_t);
+    }
+    double vec_secs = now_s() - start;
+
+    start = now_s();
+    SmallEdges* small = malloc(NODES * sizeof(SmallEdges));
+    size_t small_heap = 0;
+    for (size_t i = 0; i < NODES; ++i) {
+        small_vec_init(&small[i]);
+        for (size_t j = 0; j < degree[i]; ++j) {
+            small_vec_append(&small[i], (i + j + 1) % NODES);
+        }
+        if (!small_vec_is_inline(&small[i])) {
+            small_heap += small[i].cap * sizeof(size_t);
+        }
+    }
+    double small_secs = now_s() - start;
+
+    for (size_t i = 0; i < NODES; ++i) {
+        for (size_t j = 0; j < degree[i]; ++j) {
+            if (vec_at(&graph[i], j) != vec_at(&small[i], j)) {
+                printf("node %zu differs\n", i);
+                return 1;
+            }
+        }
+        vec_free(&graph[i]);
+        small_vec_free(&small[i]);
+    }
+
+    printf("vec:       %.3fs, %zu KiB of heap\n", vec_secs, heap / 1024);
+    printf("small vec: %.3fs, %zu KiB of heap\n", small_secs, small_heap / 1024);
+
+    free(graph);
+    free(small);
+    free(degree);
+    return 0;
+}
@@ -0,0 +1,117 @@
+// Compares libc qsort and bsearch with the typed algorithms generated by
+// CARR_VEC_SORT_DEFINE and CARR_VEC_RADIX_SORT_DEFINE, on random 64 bit
+// integers and on small structs sorted by a float field.
+// Usage: 18-sort_bench [n], with n from 10^6 (default) up to 10^8.
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "../vec.h"
+
+typedef struct {
+    float    score;
+    uint32_t id;
+} Record;
+
+#define U64_LESS(a, b)    ((a) < (b))
+#define U64_KEY(x)        carr_radix_key_u64(x)
+#define RECORD_LESS(a, b) ((a).score < (b).score)
+#define RECORD_KEY(r)     carr_radix_key_f32((r).score)
+
+CARR_VEC_SORT_DEFINE(U64, uint64_t, U64_LESS)
+CARR_VEC_RADIX_SORT_DEFINE(U64, uint64_t, U64_KEY)
+CARR_VEC_SORT_DEFINE(Records, Record, RECORD_LESS)
+CARR_VEC_RADIX_SORT_DEFINE(Records, Record, RECORD_KEY)
+
+int u64_compare(const void* a, const void* b)
+{
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+int record_compare(const void* a, const void* b)
+{
+    float x = ((const Record*)a)->score;
+    float y = ((const Record*)b)->score;
+    return (x > y) - (x < y);
+}
+
+double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+uint64_t next_random(uint64_t* state)
+{
+    *state += 0x9e3779b97f4a7c15ull;
+    uint64_t z = *state;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+#define BENCH(label, n, src, dst, size, call)                                  \
+do {                                                                           \
+    memcpy((dst), (src), (n) * (size));                                        \
+    double start = now_s();                                                    \
+    call;                                                                      \
+    printf("  %-12s %8.3fs\n", (label), now_s() - start);                      \
+} while (0)
+
+int main(int argc, char** argv)
+{
+    size_t n = argc > 1 ? (size_t)atoll(argv[1]) : 1000000;
+    uint64_t state = 42;
+
+    uint64_t* keys = malloc(n * sizeof(uint64_t));
+    uint64_t* work = malloc(n * sizeof(uint64_t));
+    for (size_t i = 0; i < n; ++i) {
+        keys[i] = next_random(&state);
+    }
+
+    printf("%zu uint64_t:\n", n);
+    BENCH("qsort", n, keys, work, sizeof(uint64_t),
+          qsort(work, n, sizeof(uint64_t), u64_compare));
+    BENCH("sort", n, keys, work, sizeof(uint64_t), U64_sort(work, n));
+    BENCH("stable_sort", n, keys, work, sizeof(uint64_t), U64_stable_sort(work, n));
+    BENCH("radix_sort", n, keys, work, sizeof(uint64_t), U64_radix_sort(work, n));
+
+    // work is sorted now: look up every key with both searches.
+    size_t found = 0;
+    double start = now_s();
+    for (size_t i = 0; i < n; ++i) {
+        found += bsearch(&keys[i], work, n, sizeof(uint64_t), u64_compare) != NULL;
+    }
+    printf("  %-12s %8.3fs\n", "bsearch", now_s() - start);
+    start = now_s();
+    for (size_t i = 0; i < n; ++i) {
+        size_t idx = U64_lower_bound(work, n, keys[i]);
+        found -= idx < n && work[idx] == keys[i];
+    }
+    printf("  %-12s %8.3fs\n", "lower_bound", now_s() - start);
+
+    Record* records = malloc(n * sizeof(Record));
+    Record* rwork   = malloc(n * sizeof(Record));
+    for (size_t i = 0; i < n; ++i) {
+        records[i] = (Record){
+            .score = (float)(next_random(&state) % 2000000) / 1000.0f - 1000.0f,
+            .id    = (uint32_t)i,
+        };
+    }
+
+    printf("%zu Record {float, uint32_t}:\n", n);
+    BENCH("qsort", n, records, rwork, sizeof(Record),
+          qsort(rwork, n, sizeof(Record), record_compare));
+    BENCH("sort", n, records, rwork, sizeof(Record), Records_sort(rwork, n));
+    BENCH("stable_sort", n, records, rwork, sizeof(Record), Records_stable_sort(rwork, n));
+    BENCH("radix_sort", n, records, rwork, sizeof(Record), Records_radix_sort(rwork, n));
+
+    free(keys);
+    free(work);
+    free(records);
+    free(rwork);
+    return found != 0;
+}
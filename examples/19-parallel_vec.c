@@ -0,0 +1,124 @@
+// Runs a parallel_for, a parallel_reduce and a parallel sort over a vec
+// of N doubles, and compares them with their single threaded versions.
+// Usage: 19-parallel_vec [workers], 0 (default) means one per core.
+#include <math.h>
+#include <stdio.h>
+#include <time.h>
+
+#define CARR_POOL_IMPLEMENTATION
+#include "../pool.h"
+
+#define N     (1 << 24)
+#define CHUNK 65536
+
+typedef struct {
+    double* items;
+    size_t  len;
+    size_t  cap;
+} Doubles;
+
+#define DOUBLE_LESS(a, b) ((a) < (b))
+
+CARR_VEC_SORT_DEFINE(Doubles, double, DOUBLE_LESS)
+CARR_POOL_SORT_DEFINE(Doubles, double)
+
+double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// A deliberately uneven amount of work per item, so some chunks cost
+// much more than others and have to be stolen to keep all cores busy.
+void transform(void* items, size_t start, size_t end, void* acc, void* ctx)
+{
+    (void)acc;
+    (void)ctx;
+    double* xs = (double*)items;
+    for (size_t i = start; i < end; ++i) {
+        int rounds = (i % 1024 == 0) ? 200 : 1;
+        for (int r = 0; r < rounds; ++r) {
+            xs[i] = sin(xs[i]) + 1.0;
+        }
+    }
+}
+
+void sum_squares(void* items, size_t start, size_t end, void* acc, void* ctx)
+{
+    (void)ctx;
+    double* xs  = (double*)items;
+    double  sum = 0;
+    for (size_t i = start; i < end; ++i) {
+        sum += xs[i] * xs[i];
+    }
+    *(double*)acc += sum;
+}
+
+void add(void* dst, const void* src, void* ctx)
+{
+    (void)ctx;
+    *(double*)dst += *(const double*)src;
+}
+
+void fill(Doubles* v)
+{
+    uint64_t state = 42;
+    for (size_t i = 0; i < v->len; ++i) {
+        state = state * 6364136223846793005ull + 1442695040888963407ull;
+        v->items[i] = (double)(state >> 11) / (double)(1ull << 53);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    size_t workers = argc > 1 ? (size_t)atoi(argv[1]) : 0;
+
+    Pool pool;
+    pool_init(&pool, workers);
+    printf("%zu workers + the main thread\n", pool.n_workers);
+
+    Doubles v;
+    vec_init(&v);
+    vec_resize(&v, N);
+
+    fill(&v);
+    double start = now_s();
+    transform(v.items, 0, v.len, NULL, NULL);
+    double serial = now_s() - start;
+    fill(&v);
+    start = now_s();
+    parallel_for(&pool, &v, CHUNK, transform, NULL);
+    printf("for:    serial %.3fs, parallel %.3fs\n", serial, now_s() - start);
+
+    double identity = 0, expected = 0, total = 0;
+    start = now_s();
+    sum_squares(v.items, 0, v.len, &expected, NULL);
+    serial = now_s() - start;
+    start = now_s();
+    parallel_reduce(&pool, &v, CHUNK, &identity, sum_squares, add, &total, NULL);
+    printf("reduce: serial %.3fs, parallel %.3fs\n", serial, now_s() - start);
+    if (fabs(total - expected) > 1e-6 * expected) {
+        printf("reduce mismatch: %f vs %f\n", total, expected);
+        return 1;
+    }
+
+    fill(&v);
+    start = now_s();
+    vec_sort(&v, Doubles);
+    serial = now_s() - start;
+    fill(&v);
+    start = now_s();
+    vec_parallel_sort(&pool, &v, Doubles);
+    printf("sort:   serial %.3fs, parallel %.3fs\n", serial, now_s() - start);
+    for (size_t i = 1; i < v.len; ++i) {
+        if (v.items[i] < v.items[i - 1]) {
+            printf("not sorted at %zu\n", i);
+            return 1;
+        }
+    }
+
+    vec_free(&v);
+    pool_free(&pool);
+    return 0;
+}
@@ -0,0 +1,85 @@
+// Appends N 64 bit integers to a vec or to a segvec and reports the
+// slowest batch of BATCH appends (where a vec pays for its growths) and
+// the peak memory of the process.
+// Usage: 20-segmented_vec vec|segvec
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include "../vec.h"
+
+#define N     ((size_t)1 << 26)
+#define BATCH 4096
+
+typedef struct {
+    uint64_t* items;
+    size_t    len;
+    size_t    cap;
+} U64s;
+
+typedef struct {
+    uint64_t* blocks[CARR_SEGVEC_MAX_BLOCKS];
+    size_t    len;
+} SegU64s;
+
+double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char** argv)
+{
+    bool segmented = argc > 1 && strcmp(argv[1], "segvec") == 0;
+
+    double   worst = 0;
+    uint64_t sum   = 0;
+    double   start = now_s();
+    if (segmented) {
+        SegU64s sv;
+        segvec_init(&sv);
+        for (size_t i = 0; i < N; i += BATCH) {
+            double t = now_s();
+            for (size_t j = i; j < i + BATCH; ++j) {
+                segvec_append(&sv, j);
+            }
+            t = now_s() - t;
+            worst = t > worst ? t : worst;
+        }
+        uint64_t* block;
+        segvec_foreach_block(&sv, block, n) {
+            for (size_t i = 0; i < n; ++i) {
+                sum += block[i];
+            }
+        }
+        segvec_free(&sv);
+    } else {
+        U64s v;
+        vec_init(&v);
+        for (size_t i = 0; i < N; i += BATCH) {
+            double t = now_s();
+            for (size_t j = i; j < i + BATCH; ++j) {
+                vec_append(&v, j);
+            }
+            t = now_s() - t;
+            worst = t > worst ? t : worst;
+        }
+        for (size_t i = 0; i < v.len; ++i) {
+            sum += v.items[i];
+        }
+        vec_free(&v);
+    }
+    double secs = now_s() - start;
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    printf(
+        "%-6s: %zu appends in %.3fs, slowest batch %.3fms, peak RSS %ld MiB\n",
+        segmented ? "segvec" : "vec", N, secs, worst * 1e3,
+        usage.ru_maxrss / 1024
+    );
+    return sum != (uint64_t)N * (N - 1) / 2;
+}
@@ -0,0 +1,77 @@
+// Keeps a table of people in a file across runs: every run opens the
+// file (mapping the records already there, without reading them in),
+// checks them, appends BATCH new ones with the plain vec_append (which
+// grows the file as it goes) and closes it with vec_free.
+// Usage: 21-mmap_vec [path]
+#include <stdio.h>
+#include <time.h>
+
+#define CARR_MVEC_IMPLEMENTATION
+#include "../mvec.h"
+
+#define BATCH 1000000
+
+typedef struct {
+    char   name[32];
+    int    age;
+    double score;
+} Person;
+
+typedef struct {
+    Person*      items;
+    size_t       len;
+    size_t       cap;
+    CarrMVecFile file;
+} PersonVec;
+
+double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+Person make_person(size_t id)
+{
+    Person p = { .age = (int)(id % 100), .score = id * 0.5 };
+    snprintf(p.name, sizeof(p.name), "person-%zu", id);
+    return p;
+}
+
+int main(int argc, char** argv)
+{
+    const char* path = argc > 1 ? argv[1] : "/tmp/people.mvec";
+
+    PersonVec people;
+    double start = now_s();
+    if (!mvec_open(&people, path, 1024)) {
+        return 1;
+    }
+    printf("opened %zu people in %.6fs\n", people.len, now_s() - start);
+
+    // The records are read straight from the page cache (or the disk).
+    mvec_advise(&people, MADV_SEQUENTIAL);
+    start = now_s();
+    for (size_t i = 0; i < people.len; ++i) {
+        Person expected = make_person(i);
+        if (
+            strcmp(vec_at(&people, i).name, expected.name) != 0 ||
+            vec_at(&people, i).age != expected.age
+        ) {
+            printf("person %zu is corrupted\n", i);
+            return 1;
+        }
+    }
+    printf("checked them in %.3fs\n", now_s() - start);
+
+    // Growing only extends the file, the records already there stay put.
+    start = now_s();
+    for (size_t i = 0, id = people.len; i < BATCH; ++i, ++id) {
+        vec_append(&people, make_person(id));
+    }
+    printf("appended %d people in %.3fs\n", BATCH, now_s() - start);
+
+    // Same as mvec_close: the file is trimmed to the records and unmapped.
+    vec_free(&people);
+    return 0;
+}
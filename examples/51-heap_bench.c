@@ -0,0 +1,97 @@
+// Runs a discrete event simulation style workload on a min heap of
+// events: n pushes, then m "hold" steps (pop the earliest event, push
+// one a random delay later) and n pops, once with the heap_* macros and
+// their compare function and once with a heap generated by
+// CARR_HEAP_DEFINE, whose comparison is inlined.
+// Usage: 51-heap_bench [n] [m], 10^6 and 10^7 by default.
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "../vec.h"
+
+typedef struct {
+    double   time;
+    uint32_t id;
+} Event;
+
+typedef struct {
+    Event*              items;
+    size_t              len;
+    size_t              cap;
+    HeapCompareFunction compare;
+} EventHeap;
+
+typedef struct {
+    Event* items;
+    size_t len;
+    size_t cap;
+} Events;
+
+bool Event_compare(void* a, void* b)
+{
+    return ((Event*)a)->time < ((Event*)b)->time;
+}
+
+#define EVENT_EARLIER(a, b) ((a).time < (b).time)
+
+CARR_HEAP_DEFINE(Events, Event, EVENT_EARLIER)
+
+double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+double next_delay(uint64_t* state)
+{
+    *state = *state * 6364136223846793005ull + 1442695040888963407ull;
+    return (double)(*state >> 11) / (double)(1ull << 53);
+}
+
+#define BENCH(label, h, push, pop)                                             \
+do {                                                                           \
+    uint64_t state = 42;                                                       \
+    double   sum   = 0;                                                        \
+    double   start = now_s();                                                  \
+    for (uint32_t i = 0; i < n; ++i) {                                         \
+        push((h), ((Event){ .time = next_delay(&state), .id = i }));           \
+    }                                                                          \
+    for (size_t i = 0; i < m; ++i) {                                           \
+        Event e;                                                               \
+        pop((h), &e);                                                          \
+        e.time += next_delay(&state);                                          \
+        push((h), e);                                                          \
+    }                                                                          \
+    while ((h)->len > 0) {                                                     \
+        Event e;                                                               \
+        pop((h), &e);                                                          \
+        sum += e.time;                                                         \
+    }                                                                          \
+    double secs = now_s() - start;                                             \
+    printf(                                                                    \
+        "%-10s %.3fs, %.1f ns per operation (checksum %.6e)\n",                \
+        (label), secs, secs * 1e9 / (2 * n + 2 * m), sum                       \
+    );                                                                         \
+} while (0)
+
+#define TYPED_PUSH(h, e) typed_heap_push((h), Events, (e))
+#define TYPED_POP(h, e)  typed_heap_pop((h), Events, (e))
+
+int main(int argc, char** argv)
+{
+    size_t n = argc > 1 ? (size_t)atoll(argv[1]) : 1000000;
+    size_t m = argc > 2 ? (size_t)atoll(argv[2]) : 10000000;
+
+    EventHeap heap;
+    heap_new(&heap, Event_compare);
+    BENCH("heap_*", &heap, heap_push, heap_pop);
+    vec_free(&heap);
+
+    Events typed;
+    vec_init(&typed);
+    BENCH("typed", &typed, TYPED_PUSH, TYPED_POP);
+    vec_free(&typed);
+    return 0;
+}
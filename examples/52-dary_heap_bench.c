@@ -0,0 +1,108 @@
+// Compares binary, 4-ary and 8-ary heaps of 16 byte events, generated by
+// CARR_DARY_HEAP_DEFINE on a plain vec and by CARR_ALIGNED_DARY_HEAP_DEFINE,
+// at sizes from 10^4 up to max: n pushes, HOLD "hold" steps (pop the
+// earliest event, push it back later), n pops.
+// Usage: 52-dary_heap_bench [max], 10^7 by default (10^8 takes ~2 GiB).
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "../vec.h"
+
+#define HOLD 1000000
+
+typedef struct {
+    double   time;
+    uint64_t id;
+} Event;
+
+typedef struct {
+    Event* items;
+    size_t len;
+    size_t cap;
+} Events;
+
+#define EVENT_EARLIER(a, b) ((a).time < (b).time)
+
+CARR_DARY_HEAP_DEFINE(Binary, Event, EVENT_EARLIER, 2)
+CARR_DARY_HEAP_DEFINE(Quad, Event, EVENT_EARLIER, 4)
+CARR_DARY_HEAP_DEFINE(Octo, Event, EVENT_EARLIER, 8)
+CARR_ALIGNED_DARY_HEAP_DEFINE(AlignedQuad, Event, EVENT_EARLIER, 4)
+CARR_ALIGNED_DARY_HEAP_DEFINE(AlignedOcto, Event, EVENT_EARLIER, 8)
+
+double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+double next_delay(uint64_t* state)
+{
+    *state = *state * 6364136223846793005ull + 1442695040888963407ull;
+    return (double)(*state >> 11) / (double)(1ull << 53);
+}
+
+// How BENCH sets up, grows and frees each kind of heap.
+#define VEC_INIT(h, Name)           vec_init((h))
+#define VEC_RESERVE(h, Name, n)     vec_reserve((h), (n))
+#define VEC_PUSH(h, Name, e)        typed_heap_push((h), Name, (e))
+#define VEC_FREE(h, Name)           vec_free((h))
+#define ALIGNED_INIT(h, Name)       Name##_init((h))
+#define ALIGNED_RESERVE(h, Name, n) Name##_reserve((h), (n))
+#define ALIGNED_PUSH(h, Name, e)    Name##_push((h), (e))
+#define ALIGNED_FREE(h, Name)       Name##_free((h))
+
+#define BENCH(Name, Heap, KIND, n)                                             \
+do {                                                                           \
+    Heap     h;                                                                \
+    uint64_t state = 42;                                                       \
+    double   check = 0;                                                        \
+    KIND##_INIT(&h, Name);                                                     \
+    KIND##_RESERVE(&h, Name, (n));                                             \
+                                                                               \
+    double start = now_s();                                                    \
+    for (size_t i = 0; i < (n); ++i) {                                         \
+        Event e = { .time = next_delay(&state), .id = i };                     \
+        KIND##_PUSH(&h, Name, e);                                              \
+    }                                                                          \
+    double push = now_s() - start;                                             \
+                                                                               \
+    start = now_s();                                                           \
+    for (size_t i = 0; i < HOLD; ++i) {                                        \
+        Event e;                                                               \
+        typed_heap_pop(&h, Name, &e);                                          \
+        e.time += next_delay(&state);                                          \
+        KIND##_PUSH(&h, Name, e);                                              \
+    }                                                                          \
+    double hold = now_s() - start;                                             \
+                                                                               \
+    start = now_s();                                                           \
+    while (h.len > 0) {                                                        \
+        Event e;                                                               \
+        typed_heap_pop(&h, Name, &e);                                          \
+        check += e.time;                                                       \
+    }                                                                          \
+    double pop = now_s() - start;                                              \
+                                                                               \
+    printf(                                                                    \
+        "  %-11s push %7.1f ns, hold %7.1f ns, pop %7.1f ns (check %.6e)\n",   \
+        #Name, push * 1e9 / (n), hold * 1e9 / HOLD, pop * 1e9 / (n), check     \
+    );                                                                         \
+    KIND##_FREE(&h, Name);                                                     \
+} while (0)
+
+int main(int argc, char** argv)
+{
+    size_t max = argc > 1 ? (size_t)atoll(argv[1]) : 10000000;
+
+    for (size_t n = 10000; n <= max; n *= 10) {
+        printf("%zu events:\n", n);
+        BENCH(Binary, Events, VEC, n);
+        BENCH(Quad, Events, VEC, n);
+        BENCH(Octo, Events, VEC, n);
+        BENCH(AlignedQuad, AlignedQuad, ALIGNED, n);
+        BENCH(AlignedOcto, AlignedOcto, ALIGNED, n);
+    }
+    return 0;
+}
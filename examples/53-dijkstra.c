@@ -0,0 +1,174 @@
+// Runs Dijkstra's algorithm on a random graph twice: with a plain heap,
+// pushing a node again every time its distance drops and skipping the
+// stale entries, and with an indexed heap, lowering the distance of the
+// entry already there.
+// Usage: 53-dijkstra [nodes] [edges per node], 10^6 and 8 by default.
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "../vec.h"
+
+typedef struct {
+    double   dist;
+    uint32_t node;
+} Entry;
+
+typedef struct {
+    Entry* items;
+    size_t len;
+    size_t cap;
+} Entries;
+
+#define ENTRY_CLOSER(a, b) ((a).dist < (b).dist)
+
+CARR_HEAP_DEFINE(Entries, Entry, ENTRY_CLOSER)
+CARR_INDEXED_HEAP_DEFINE(Frontier, Entry, ENTRY_CLOSER)
+
+// Adjacency lists, with the edges of node i at first[i]..first[i + 1].
+typedef struct {
+    size_t    n;
+    size_t*   first;
+    uint32_t* to;
+    double*   weight;
+} Graph;
+
+double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+uint64_t next_random(uint64_t* state)
+{
+    *state = *state * 6364136223846793005ull + 1442695040888963407ull;
+    return *state >> 11;
+}
+
+Graph random_graph(size_t n, size_t degree)
+{
+    uint64_t state = 42;
+    Graph g = {
+        .n      = n,
+        .first  = malloc((n + 1) * sizeof(size_t)),
+        .to     = malloc(n * degree * sizeof(uint32_t)),
+        .weight = malloc(n * degree * sizeof(double)),
+    };
+    for (size_t i = 0; i <= n; ++i) {
+        g.first[i] = i * degree;
+    }
+    for (size_t e = 0; e < n * degree; ++e) {
+        g.to[e]     = (uint32_t)(next_random(&state) % n);
+        g.weight[e] = (double)(next_random(&state) % 1000 + 1);
+    }
+    return g;
+}
+
+double lazy_dijkstra(Graph* g, double* dist, size_t* max_len)
+{
+    Entries heap;
+    vec_init(&heap);
+    for (size_t i = 0; i < g->n; ++i) {
+        dist[i] = INFINITY;
+    }
+    dist[0] = 0;
+    typed_heap_push(&heap, Entries, ((Entry){ .dist = 0, .node = 0 }));
+
+    *max_len = 0;
+    while (heap.len > 0) {
+        *max_len = heap.len > *max_len ? heap.len : *max_len;
+        Entry e;
+        typed_heap_pop(&heap, Entries, &e);
+        if (e.dist > dist[e.node]) {
+            continue; // Stale: the node was reached by a shorter path.
+        }
+        for (size_t k = g->first[e.node]; k < g->first[e.node + 1]; ++k) {
+            double d = e.dist + g->weight[k];
+            if (d < dist[g->to[k]]) {
+                dist[g->to[k]] = d;
+                Entry next = { .dist = d, .node = g->to[k] };
+                typed_heap_push(&heap, Entries, next);
+            }
+        }
+    }
+    vec_free(&heap);
+
+    double sum = 0;
+    for (size_t i = 0; i < g->n; ++i) {
+        sum += isinf(dist[i]) ? 0 : dist[i];
+    }
+    return sum;
+}
+
+double indexed_dijkstra(Graph* g, double* dist, size_t* max_len)
+{
+    Frontier heap;
+    Frontier_init(&heap);
+    // The heap handle of every node, or CARR_HEAP_NO_POS.
+    size_t* handle = malloc(g->n * sizeof(size_t));
+    for (size_t i = 0; i < g->n; ++i) {
+        dist[i]   = INFINITY;
+        handle[i] = CARR_HEAP_NO_POS;
+    }
+    dist[0]   = 0;
+    handle[0] = Frontier_push(&heap, (Entry){ .dist = 0, .node = 0 });
+
+    *max_len = 0;
+    while (heap.len > 0) {
+        *max_len = heap.len > *max_len ? heap.len : *max_len;
+        Entry e;
+        Frontier_pop(&heap, &e);
+        handle[e.node] = CARR_HEAP_NO_POS;
+        for (size_t k = g->first[e.node]; k < g->first[e.node + 1]; ++k) {
+            uint32_t to = g->to[k];
+            double   d  = e.dist + g->weight[k];
+            if (d < dist[to]) {
+                dist[to] = d;
+                Entry next = { .dist = d, .node = to };
+                if (handle[to] == CARR_HEAP_NO_POS) {
+                    handle[to] = Frontier_push(&heap, next);
+                } else {
+                    Frontier_increase(&heap, handle[to], next);
+                }
+            }
+        }
+    }
+    Frontier_free(&heap);
+    free(handle);
+
+    double sum = 0;
+    for (size_t i = 0; i < g->n; ++i) {
+        sum += isinf(dist[i]) ? 0 : dist[i];
+    }
+    return sum;
+}
+
+int main(int argc, char** argv)
+{
+    size_t n      = argc > 1 ? (size_t)atoll(argv[1]) : 1000000;
+    size_t degree = argc > 2 ? (size_t)atoll(argv[2]) : 8;
+
+    Graph   g    = random_graph(n, degree);
+    double* dist = malloc(n * sizeof(double));
+
+    size_t max_len;
+    double start = now_s();
+    double lazy  = lazy_dijkstra(&g, dist, &max_len);
+    printf(
+        "lazy:    %.3fs, heap of up to %zu entries\n", now_s() - start, max_len
+    );
+
+    start = now_s();
+    double indexed = indexed_dijkstra(&g, dist, &max_len);
+    printf(
+        "indexed: %.3fs, heap of up to %zu entries\n", now_s() - start, max_len
+    );
+
+    free(g.first);
+    free(g.to);
+    free(g.weight);
+    free(dist);
+    return lazy != indexed;
+}
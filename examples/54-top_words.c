@@ -0,0 +1,139 @@
+// Prints the K most frequent words of examples/fpessoa.txt with a top-K
+// selection, then times three ways of picking the K highest of N random
+// scores: sorting them all, heaping them all and popping K, and
+// streaming them through the top-K selection.
+// Usage: 54-top_words [k] [n], 10 and 10^7 by default.
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#define CARR_MAP_IMPLEMENTATION
+#include "../map.h"
+
+#define CARR_SV_IMPLEMENTATION
+#include "../sv.h"
+
+#include "../vec.h"
+
+CARR_MAP_DEFINE(WordCount, StringView, int, carr_map_sv_hash, carr_map_sv_eq)
+
+#define MORE_FREQUENT(a, b) ((a).value > (b).value)
+
+CARR_TOP_K_DEFINE(TopWords, WordCountItem, MORE_FREQUENT)
+
+typedef struct {
+    uint64_t* items;
+    size_t    len;
+    size_t    cap;
+} Scores;
+
+#define GREATER(a, b) ((a) > (b))
+
+CARR_VEC_SORT_DEFINE(Descending, uint64_t, GREATER)
+CARR_HEAP_DEFINE(Scores, uint64_t, GREATER)
+CARR_TOP_K_DEFINE(TopScores, uint64_t, GREATER)
+
+double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+uint64_t next_random(uint64_t* state)
+{
+    *state += 0x9e3779b97f4a7c15ull;
+    uint64_t z = *state;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+void top_words(size_t k)
+{
+    WordCount freqs;
+    WordCount_init(&freqs);
+
+    StringBuilder buf = sb_from_file("examples/fpessoa.txt");
+    StringView file_view = sv_from_sb(buf);
+    while (file_view.len > 0) {
+        StringView line_view = sv_chop_line(&file_view);
+        while (line_view.len > 0) {
+            StringView word = sv_chop_by_space(&line_view);
+            sv_strip_space(&word);
+            *WordCount_upsert(&freqs, word) += 1;
+        }
+    }
+
+    TopWords top;
+    TopWords_init(&top, k);
+    for (size_t i = 0; i < freqs.cap; ++i) {
+        if (carr_map_slot_full(&freqs, i)) {
+            TopWords_offer(&top, freqs.items[i]);
+        }
+    }
+    TopWords_sort(&top);
+    for (size_t i = 0; i < top.len; ++i) {
+        WordCountItem item = top.items[i];
+        printf("%.*s: %d\n", (int)item.key.len, item.key.data, item.value);
+    }
+
+    TopWords_free(&top);
+    WordCount_free(&freqs);
+    sb_free(&buf);
+}
+
+int main(int argc, char** argv)
+{
+    size_t k = argc > 1 ? (size_t)atoll(argv[1]) : 10;
+    size_t n = argc > 2 ? (size_t)atoll(argv[2]) : 10000000;
+
+    top_words(k);
+
+    uint64_t state = 42;
+    Scores   scores;
+    vec_init(&scores);
+    for (size_t i = 0; i < n; ++i) {
+        vec_append(&scores, next_random(&state));
+    }
+    uint64_t* best = malloc(k * sizeof(uint64_t));
+    uint64_t  checks[3] = {0};
+
+    // Each one works on its own copy, as the scores would be streamed.
+    Scores copy;
+    vec_init(&copy);
+    vec_extend(&copy, scores.items, scores.len);
+    double start = now_s();
+    vec_sort(&copy, Descending);
+    for (size_t i = 0; i < k && i < copy.len; ++i) {
+        checks[0] += copy.items[i];
+    }
+    printf("sort all:      %.3fs\n", now_s() - start);
+
+    copy.len = 0;
+    start = now_s();
+    typed_heap_push_many(&copy, Scores, scores.items, scores.len);
+    typed_heap_pop_k(&copy, Scores, best, k);
+    for (size_t i = 0; i < k && i < scores.len; ++i) {
+        checks[1] += best[i];
+    }
+    printf("heap all:      %.3fs\n", now_s() - start);
+    vec_free(&copy);
+
+    TopScores top;
+    start = now_s();
+    TopScores_init(&top, k);
+    for (size_t i = 0; i < scores.len; ++i) {
+        TopScores_offer(&top, scores.items[i]);
+    }
+    TopScores_sort(&top);
+    for (size_t i = 0; i < top.len; ++i) {
+        checks[2] += top.items[i];
+    }
+    printf("top-%zu stream: %.3fs\n", k, now_s() - start);
+    TopScores_free(&top);
+
+    vec_free(&scores);
+    free(best);
+    return checks[0] != checks[1] || checks[1] != checks[2];
+}
@@ -0,0 +1,110 @@
+// A timer queue: n timers are pending, and each step fires the earliest
+// one and sets it again a random delay (up to a millisecond, in
+// nanoseconds) after it. Times the heap_* macros with their compare
+// function, a typed binary heap, a typed 4-ary heap and a radix heap.
+// Usage: 55-timer_queue [n] [steps], 10^5 and 10^7 by default.
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "../vec.h"
+
+typedef struct {
+    uint64_t deadline;
+    uint64_t id;
+} Timer;
+
+typedef struct {
+    Timer*              items;
+    size_t              len;
+    size_t              cap;
+    HeapCompareFunction compare;
+} TimerHeap;
+
+typedef struct {
+    Timer* items;
+    size_t len;
+    size_t cap;
+} Timers;
+
+bool Timer_compare(void* a, void* b)
+{
+    return ((Timer*)a)->deadline < ((Timer*)b)->deadline;
+}
+
+#define TIMER_EARLIER(a, b) ((a).deadline < (b).deadline)
+#define TIMER_KEY(t)        ((t).deadline)
+
+CARR_HEAP_DEFINE(Binary, Timer, TIMER_EARLIER)
+CARR_DARY_HEAP_DEFINE(Quad, Timer, TIMER_EARLIER, 4)
+CARR_RADIX_HEAP_DEFINE(RadixTimers, Timer, TIMER_KEY)
+
+double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+uint64_t next_delay(uint64_t* state)
+{
+    *state = *state * 6364136223846793005ull + 1442695040888963407ull;
+    return (*state >> 11) % 1000000;
+}
+
+// Runs the simulation with push(h, timer) and pop(h, &timer), and prints
+// the time per step. The check is the sum of the fired deadlines: ties may
+// fire in any order, but the earliest deadline is the same for every queue.
+#define BENCH(label, h, push, pop)                                             \
+do {                                                                           \
+    uint64_t state = 42;                                                       \
+    uint64_t fired = 0;                                                        \
+    for (size_t i = 0; i < n; ++i) {                                           \
+        push((h), ((Timer){ .deadline = next_delay(&state), .id = i }));       \
+    }                                                                          \
+    double start = now_s();                                                    \
+    for (size_t i = 0; i < steps; ++i) {                                       \
+        Timer t;                                                               \
+        pop((h), &t);                                                          \
+        fired += t.deadline;                                                   \
+        t.deadline += next_delay(&state);                                      \
+        push((h), t);                                                          \
+    }                                                                          \
+    double secs = now_s() - start;                                             \
+    printf(                                                                    \
+        "%-8s %6.1f ns per step (check %llu)\n",                               \
+        (label), secs * 1e9 / steps, (unsigned long long)fired                 \
+    );                                                                         \
+} while (0)
+
+#define BINARY_PUSH(h, t) typed_heap_push((h), Binary, (t))
+#define BINARY_POP(h, t)  typed_heap_pop((h), Binary, (t))
+#define QUAD_PUSH(h, t)   typed_heap_push((h), Quad, (t))
+#define QUAD_POP(h, t)    typed_heap_pop((h), Quad, (t))
+
+int main(int argc, char** argv)
+{
+    size_t n     = argc > 1 ? (size_t)atoll(argv[1]) : 100000;
+    size_t steps = argc > 2 ? (size_t)atoll(argv[2]) : 10000000;
+
+    TimerHeap heap;
+    heap_new(&heap, Timer_compare);
+    BENCH("heap_*", &heap, heap_push, heap_pop);
+    vec_free(&heap);
+
+    Timers binary;
+    vec_init(&binary);
+    BENCH("binary", &binary, BINARY_PUSH, BINARY_POP);
+    vec_free(&binary);
+
+    Timers quad;
+    vec_init(&quad);
+    BENCH("4-ary", &quad, QUAD_PUSH, QUAD_POP);
+    vec_free(&quad);
+
+    RadixTimers radix;
+    RadixTimers_init(&radix);
+    BENCH("radix", &radix, RadixTimers_push, RadixTimers_pop);
+    RadixTimers_free(&radix);
+    return 0;
+}
@@ -0,0 +1,196 @@
+// Compares a MultiQueue with a single heap behind a mutex as the shared
+// ready queue of P threads, and measures how relaxed its pops are.
+// Throughput: the queue starts with PREFILL tasks, and every thread pops
+// one and pushes a new one, STEPS times.
+// Rank error: one thread pops every task of a queue with the shards of P
+// threads, and counts how many better tasks were still queued each time.
+// Usage: 56-multiqueue [max threads], twice the cores by default.
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "../mqueue.h"
+
+#define PREFILL (1 << 20)
+#define STEPS   (1 << 20)
+
+typedef struct {
+    uint64_t priority;
+    uint64_t id;
+} Task;
+
+typedef struct {
+    Task*  items;
+    size_t len;
+    size_t cap;
+} Tasks;
+
+#define TASK_KEY(t)       ((t).priority)
+#define TASK_BEFORE(a, b) ((a).priority < (b).priority)
+
+CARR_MQUEUE_DEFINE(ReadyQueue, Task, TASK_KEY)
+CARR_HEAP_DEFINE(Tasks, Task, TASK_BEFORE)
+
+// The baseline: one heap, one lock.
+typedef struct {
+    pthread_mutex_t lock;
+    Tasks           heap;
+} LockedHeap;
+
+typedef struct {
+    bool        multi;
+    ReadyQueue* queue;
+    LockedHeap* locked;
+    uint64_t    seed;
+    uint64_t    check;
+} Worker;
+
+double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+uint64_t next_random(uint64_t* state)
+{
+    *state = *state * 6364136223846793005ull + 1442695040888963407ull;
+    return *state >> 24;
+}
+
+void* work(void* arg)
+{
+    Worker* w = (Worker*)arg;
+    for (size_t i = 0; i < STEPS; ++i) {
+        Task t;
+        Task next = { .priority = next_random(&w->seed), .id = i };
+        if (w->multi) {
+            ReadyQueue_pop(w->queue, &t);
+            ReadyQueue_push(w->queue, next);
+        } else {
+            pthread_mutex_lock(&w->locked->lock);
+            typed_heap_pop(&w->locked->heap, Tasks, &t);
+            typed_heap_push(&w->locked->heap, Tasks, next);
+            pthread_mutex_unlock(&w->locked->lock);
+        }
+        w->check += t.id;
+    }
+    return NULL;
+}
+
+double throughput(bool multi, size_t n_threads)
+{
+    ReadyQueue queue;
+    LockedHeap locked;
+    uint64_t   state = 42;
+    if (multi) {
+        ReadyQueue_init(&queue, CARR_MQUEUE_SHARDS_PER_CORE * n_threads);
+    } else {
+        pthread_mutex_init(&locked.lock, NULL);
+        vec_init(&locked.heap);
+    }
+    for (size_t i = 0; i < PREFILL; ++i) {
+        Task t = { .priority = next_random(&state), .id = i };
+        if (multi) {
+            ReadyQueue_push(&queue, t);
+        } else {
+            typed_heap_push(&locked.heap, Tasks, t);
+        }
+    }
+
+    pthread_t threads[n_threads];
+    Worker    workers[n_threads];
+    double    start = now_s();
+    for (size_t i = 0; i < n_threads; ++i) {
+        workers[i] = (Worker){
+            .multi  = multi,
+            .queue  = &queue,
+            .locked = &locked,
+            .seed   = i + 1,
+        };
+        pthread_create(&threads[i], NULL, work, &workers[i]);
+    }
+    for (size_t i = 0; i < n_threads; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    double secs = now_s() - start;
+
+    if (multi) {
+        ReadyQueue_free(&queue);
+    } else {
+        pthread_mutex_destroy(&locked.lock);
+        vec_free(&locked.heap);
+    }
+    return 2.0 * STEPS * n_threads / secs / 1e6;
+}
+
+// Counts the keys still queued below a popped one with a Fenwick tree over
+// the keys 0..n-1, and returns the mean rank error (0 for an exact queue).
+double rank_error(size_t n_shards, size_t n, size_t* max_error)
+{
+    uint32_t* tree = calloc(n + 1, sizeof(uint32_t));
+    uint64_t* keys = malloc(n * sizeof(uint64_t));
+    uint64_t  state = 42;
+    for (size_t i = 0; i < n; ++i) {
+        keys[i] = i;
+    }
+    for (size_t i = n - 1; i > 0; --i) {
+        size_t   j   = next_random(&state) % (i + 1);
+        uint64_t tmp = keys[i];
+        keys[i] = keys[j];
+        keys[j] = tmp;
+    }
+
+    ReadyQueue queue;
+    ReadyQueue_init(&queue, n_shards);
+    for (size_t i = 0; i < n; ++i) {
+        ReadyQueue_push(&queue, ((Task){ .priority = keys[i], .id = i }));
+        for (size_t k = keys[i] + 1; k <= n; k += k & -k) {
+            tree[k]++;
+        }
+    }
+
+    double total = 0;
+    *max_error = 0;
+    Task t;
+    while (ReadyQueue_pop(&queue, &t)) {
+        size_t below = 0;
+        for (size_t k = t.priority; k > 0; k -= k & -k) {
+            below += tree[k];
+        }
+        for (size_t k = t.priority + 1; k <= n; k += k & -k) {
+            tree[k]--;
+        }
+        total += below;
+        *max_error = below > *max_error ? below : *max_error;
+    }
+
+    ReadyQueue_free(&queue);
+    free(tree);
+    free(keys);
+    return total / n;
+}
+
+int main(int argc, char** argv)
+{
+    size_t max_threads = argc > 1
+        ? (size_t)atoll(argv[1])
+        : _carr_mqueue_default_shards();
+
+    printf("threads  locked heap  multiqueue  (M ops/s)\n");
+    for (size_t p = 1; p <= max_threads; p *= 2) {
+        double locked = throughput(false, p);
+        double multi  = throughput(true, p);
+        printf("%7zu  %11.2f  %10.2f\n", p, locked, multi);
+    }
+
+    printf("\nshards  mean rank error  max rank error\n");
+    for (size_t p = 1; p <= max_threads; p *= 2) {
+        size_t shards = CARR_MQUEUE_SHARDS_PER_CORE * p;
+        size_t max_error;
+        double mean = rank_error(shards, PREFILL, &max_error);
+        printf("%6zu  %15.1f  %14zu\n", shards, mean, max_error);
+    }
+    return 0;
+}
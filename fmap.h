@@ -0,0 +1,475 @@
+#ifndef CARR_FMAP_H_
+#define CARR_FMAP_H_
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "map.h"
+
+// Frozen maps: a Map that is built once and then only read can be
+// frozen into a file with carr_fmap_freeze. Any process can then open
+// that file with carr_fmap_open, which just mmaps it, and query it right
+// away: there is nothing to parse and lookups never allocate.
+// The keys are placed with a minimal perfect hash (CHD style, 'hash and
+// displace'): the keys are split in buckets of about
+// CARR_FMAP_BUCKET_SIZE keys, and each bucket stores a displacement that
+// sends all its keys to distinct slots. So there are exactly as many
+// slots as keys, and a lookup reads one displacement and one slot.
+// The file uses the native byte order and stores the hashes given by
+// CARR_MAP_HASH, so it must be read by a program built for the same
+// kind of machine and with the same CARR_MAP_HASH.
+// The file [examples/15-frozen_map.c] provides a complete example.
+
+// The user can define this macro to include only the functions
+// with the 'carr_' prefix, as to avoid name collisions.
+// If this macro is not defined, all the versions without prefix
+// will also be included by default.
+#ifndef CARR_FMAP_FORCE_PREFIX
+
+#define FMap         CarrFMap
+#define fmap_freeze  carr_fmap_freeze
+#define fmap_open    carr_fmap_open
+#define fmap_close   carr_fmap_close
+#define fmap_get     carr_fmap_get
+#define fmap_nget    carr_fmap_nget
+#define fmap_get_sv  carr_fmap_get_sv
+
+#endif // CARR_FMAP_FORCE_PREFIX
+
+#ifndef CARR_FMAP_BUCKET_SIZE
+#define CARR_FMAP_BUCKET_SIZE 4
+#endif // CARR_FMAP_BUCKET_SIZE
+
+#define CARR_FMAP_MAGIC   "CARRFMAP"
+#define CARR_FMAP_VERSION 1
+
+typedef struct {
+    char     magic[8];
+    uint32_t version;
+    uint32_t value_size;
+    uint64_t len;
+    uint64_t n_buckets;
+    uint64_t disp_off;
+    uint64_t slots_off;
+    uint64_t values_off;
+    uint64_t keys_off;
+    uint64_t size;
+} CarrFMapHeader;
+
+typedef struct {
+    uint64_t hash;
+    uint64_t key_off;
+    uint64_t key_len;
+} CarrFMapSlot;
+
+typedef struct {
+    const uint8_t*        base;
+    size_t                size;
+    const CarrFMapHeader* header;
+    const uint32_t*       disp;
+    const CarrFMapSlot*   slots;
+    const uint8_t*        values;
+    const char*           keys;
+    size_t                keys_size;
+    size_t                value_stride;
+} CarrFMap;
+
+// Writes the entries of m to the file at path. If value_size is 0, the
+// value pointers themselves are stored, which is what integers cast to
+// void* need. Otherwise every value must point to value_size bytes,
+// which are copied into the file. Returns false on failure.
+bool carr_fmap_freeze(Map* m, const char* path, size_t value_size);
+
+// Maps the file at path. Returns false on failure.
+bool carr_fmap_open(CarrFMap* f, const char* path);
+void carr_fmap_close(CarrFMap* f);
+
+// Return a pointer to the value of key inside the mapped file (to the
+// stored pointer when value_size was 0), or NULL if the key is missing.
+const void* carr_fmap_get(const CarrFMap* f, const char* key);
+const void* carr_fmap_nget(const CarrFMap* f, const char* key, size_t n);
+
+#define carr_fmap_get_sv(f, sv)                                                \
+    carr_fmap_nget((f), (sv).data, (sv).len)
+
+#ifdef CARR_FMAP_IMPLEMENTATION
+
+// Reduces x to [0, n) with a multiplication instead of a division: the
+// result is the high 64 bits of x * n. Files must place the keys the same
+// way on every build, so without __int128 the product is computed from
+// 32 bit halves, giving the same result.
+uint64_t _carr_fmap_reduce(uint64_t x, uint64_t n)
+{
+#ifdef __SIZEOF_INT128__
+    return (uint64_t)(((__uint128_t)x * n) >> 64);
+#else
+    uint64_t xh = x >> 32, xl = (uint32_t)x;
+    uint64_t nh = n >> 32, nl = (uint32_t)n;
+    uint64_t ll = xl * nl, lh = xl * nh, hl = xh * nl;
+    uint64_t mid = (ll >> 32) + (uint32_t)lh + (uint32_t)hl;
+    return xh * nh + (lh >> 32) + (hl >> 32) + (mid >> 32);
+#endif
+}
+
+uint64_t _carr_fmap_bucket(uint64_t hash, uint64_t n_buckets)
+{
+    return _carr_fmap_reduce(carr_map_hash_u64(hash), n_buckets);
+}
+
+uint64_t _carr_fmap_slot(uint64_t hash, uint32_t disp, uint64_t len)
+{
+    return _carr_fmap_reduce(
+        carr_map_hash_u64(hash ^ ((uint64_t)disp * 0x9e3779b97f4a7c15ull)),
+        len
+    );
+}
+
+size_t _carr_fmap_align8(size_t n)
+{
+    return (n + 7) & ~(size_t)7;
+}
+
+// True if count items of item_size bytes starting at off, which must be
+// 8 byte aligned, fit in a file of size bytes.
+bool _carr_fmap_section_ok(
+    uint64_t off, uint64_t count, uint64_t item_size, uint64_t size
+) {
+    return off % 8 == 0 && off >= sizeof(CarrFMapHeader) && off <= size &&
+        count <= (size - off) / item_size;
+}
+
+typedef struct {
+    const char* key;
+    size_t      key_len;
+    void*       value;
+    uint64_t    hash;
+    uint64_t    bucket;
+} _CarrFMapItem;
+
+int _carr_fmap_item_cmp(const void* a, const void* b)
+{
+    uint64_t ba = ((const _CarrFMapItem*)a)->bucket;
+    uint64_t bb = ((const _CarrFMapItem*)b)->bucket;
+    return (ba > bb) - (ba < bb);
+}
+
+typedef struct {
+    uint64_t start;
+    uint64_t len;
+    uint64_t bucket;
+} _CarrFMapBucket;
+
+int _carr_fmap_bucket_cmp(const void* a, const void* b)
+{
+    uint64_t la = ((const _CarrFMapBucket*)a)->len;
+    uint64_t lb = ((const _CarrFMapBucket*)b)->len;
+    return (la < lb) - (la > lb);
+}
+
+// Checks that no two keys of a bucket have the same hash: those could
+// never be sent to different slots. Keys with the same hash always land
+// in the same bucket, so looking inside every bucket is enough.
+bool _carr_fmap_has_collisions(_CarrFMapItem* items, _CarrFMapBucket* b)
+{
+    for (uint64_t i = 1; i < b->len; ++i) {
+        for (uint64_t j = 0; j < i; ++j) {
+            if (items[b->start + i].hash == items[b->start + j].hash) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// Finds a displacement for every bucket, biggest buckets first (while
+// the table is still mostly empty), and fills slot_of with the slot of
+// every item. items is sorted by bucket on the way.
+// Returns false if two keys have the same hash.
+bool _carr_fmap_place(
+    _CarrFMapItem* items, uint64_t len, uint64_t n_buckets,
+    uint32_t* disp, uint64_t* slot_of
+) {
+    qsort(items, len, sizeof(items[0]), _carr_fmap_item_cmp);
+
+    _CarrFMapBucket* buckets = (_CarrFMapBucket*)calloc(
+        n_buckets, sizeof(buckets[0])
+    );
+    for (uint64_t b = 0; b < n_buckets; ++b) {
+        buckets[b].bucket = b;
+    }
+    for (uint64_t i = 0; i < len; ++i) {
+        _CarrFMapBucket* b = &buckets[items[i].bucket];
+        if (b->len == 0) {
+            b->start = i;
+        }
+        b->len++;
+    }
+    for (uint64_t b = 0; b < n_buckets; ++b) {
+        if (_carr_fmap_has_collisions(items, &buckets[b])) {
+            free(buckets);
+            return false;
+        }
+    }
+    qsort(buckets, n_buckets, sizeof(buckets[0]), _carr_fmap_bucket_cmp);
+
+    uint8_t* taken = (uint8_t*)calloc(len, sizeof(uint8_t));
+    for (uint64_t bi = 0; bi < n_buckets && buckets[bi].len > 0; ++bi) {
+        _CarrFMapBucket b = buckets[bi];
+        for (uint32_t d = 0;; ++d) {
+            uint64_t i = 0;
+            for (; i < b.len; ++i) {
+                uint64_t s = _carr_fmap_slot(items[b.start + i].hash, d, len);
+                if (taken[s]) {
+                    break;
+                }
+                taken[s] = 1;
+                slot_of[b.start + i] = s;
+            }
+            if (i == b.len) {
+                disp[b.bucket] = d;
+                break;
+            }
+            // Give back the slots taken by this bucket so far.
+            for (uint64_t j = 0; j < i; ++j) {
+                taken[slot_of[b.start + j]] = 0;
+            }
+        }
+    }
+
+    free(taken);
+    free(buckets);
+    return true;
+}
+
+bool carr_fmap_freeze(Map* m, const char* path, size_t value_size)
+{
+    carr_map_finish_resize(m);
+
+    uint64_t len       = m->len;
+    uint64_t n_buckets = len / CARR_FMAP_BUCKET_SIZE + 1;
+    size_t   stride    = value_size == 0
+        ? sizeof(uint64_t)
+        : _carr_fmap_align8(value_size);
+
+    _CarrFMapItem* items   = (_CarrFMapItem*)malloc((len + 1) * sizeof(items[0]));
+    uint64_t*      slot_of = (uint64_t*)malloc((len + 1) * sizeof(slot_of[0]));
+    uint32_t*      disp    = (uint32_t*)calloc(n_buckets, sizeof(disp[0]));
+
+    size_t n = 0;
+    for (size_t i = 0; i < m->cap; ++i) {
+        if (!carr_map_slot_full(m, i)) {
+            continue;
+        }
+        uint64_t hash = m->hashes[i];
+        items[n++] = (_CarrFMapItem){
+            .key     = m->items[i].key,
+            .key_len = carr_map_key_len(m->key_lens[i]),
+            .value   = m->items[i].value,
+            .hash    = hash,
+            .bucket  = _carr_fmap_bucket(hash, n_buckets),
+        };
+    }
+
+    bool  ok = _carr_fmap_place(items, len, n_buckets, disp, slot_of);
+    FILE* f  = NULL;
+    if (!ok) {
+        printf(
+            "%s:%d:ERROR: fmap_freeze: two keys have the same hash\n",
+            __FILE_NAME__, __LINE__
+        );
+    } else if ((f = fopen(path, "wb")) == NULL) {
+        printf(
+            "%s:%d:ERROR: fmap_freeze: failed to open file '%s': %s\n",
+            __FILE_NAME__, __LINE__, path, strerror(errno)
+        );
+        ok = false;
+    }
+
+    if (ok) {
+        CarrFMapHeader h = {
+            .magic      = CARR_FMAP_MAGIC,
+            .version    = CARR_FMAP_VERSION,
+            .value_size = (uint32_t)value_size,
+            .len        = len,
+            .n_buckets  = n_buckets,
+        };
+        h.disp_off   = _carr_fmap_align8(sizeof(h));
+        h.slots_off  = _carr_fmap_align8(h.disp_off + n_buckets * sizeof(disp[0]));
+        h.values_off = h.slots_off + len * sizeof(CarrFMapSlot);
+        h.keys_off   = h.values_off + len * stride;
+
+        // item_at is the inverse of slot_of, so the keys can be written in
+        // slot order.
+        CarrFMapSlot* slots   = (CarrFMapSlot*)calloc(len + 1, sizeof(slots[0]));
+        uint8_t*      values  = (uint8_t*)calloc(len + 1, stride);
+        uint64_t*     item_at = (uint64_t*)malloc((len + 1) * sizeof(item_at[0]));
+        for (uint64_t i = 0; i < len; ++i) {
+            uint64_t s = slot_of[i];
+            item_at[s] = i;
+            if (value_size == 0) {
+                uint64_t v = (uint64_t)(uintptr_t)items[i].value;
+                memcpy(&values[s * stride], &v, sizeof(v));
+            } else {
+                memcpy(&values[s * stride], items[i].value, value_size);
+            }
+        }
+        uint64_t key_off = 0;
+        for (uint64_t s = 0; s < len; ++s) {
+            const _CarrFMapItem* it = &items[item_at[s]];
+            slots[s] = (CarrFMapSlot){ it->hash, key_off, it->key_len };
+            key_off += slots[s].key_len + 1;
+        }
+        h.size = h.keys_off + key_off;
+
+        uint8_t pad[8] = {0};
+        fwrite(&h, sizeof(h), 1, f);
+        fwrite(pad, 1, h.disp_off - sizeof(h), f);
+        fwrite(disp, sizeof(disp[0]), n_buckets, f);
+        fwrite(pad, 1, h.slots_off - h.disp_off - n_buckets * sizeof(disp[0]), f);
+        fwrite(slots, sizeof(slots[0]), len, f);
+        fwrite(values, stride, len, f);
+        for (uint64_t s = 0; s < len; ++s) {
+            fwrite(items[item_at[s]].key, 1, slots[s].key_len + 1, f);
+        }
+
+        if (ferror(f)) {
+            printf(
+                "%s:%d:ERROR: fmap_freeze: failed to write file '%s': %s\n",
+                __FILE_NAME__, __LINE__, path, strerror(errno)
+            );
+            ok = false;
+        }
+        free(slots);
+        free(values);
+        free(item_at);
+    }
+
+    if (f != NULL && fclose(f) != 0) {
+        ok = false;
+    }
+    free(items);
+    free(slot_of);
+    free(disp);
+    return ok;
+}
+
+bool carr_fmap_open(CarrFMap* f, const char* path)
+{
+    *f = (CarrFMap){0};
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        printf(
+            "%s:%d:ERROR: fmap_open: failed to open file '%s': %s\n",
+            __FILE_NAME__, __LINE__, path, strerror(errno)
+        );
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(CarrFMapHeader)) {
+        printf(
+            "%s:%d:ERROR: fmap_open: '%s' is not a frozen map\n",
+            __FILE_NAME__, __LINE__, path
+        );
+        close(fd);
+        return false;
+    }
+
+    void* base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        printf(
+            "%s:%d:ERROR: fmap_open: failed to map file '%s': %s\n",
+            __FILE_NAME__, __LINE__, path, strerror(errno)
+        );
+        return false;
+    }
+
+    const CarrFMapHeader* h = (const CarrFMapHeader*)base;
+    uint64_t size   = st.st_size;
+    size_t   stride = h->value_size == 0
+        ? sizeof(uint64_t)
+        : _carr_fmap_align8(h->value_size);
+    if (
+        memcmp(h->magic, CARR_FMAP_MAGIC, sizeof(h->magic)) != 0 ||
+        h->version != CARR_FMAP_VERSION || h->size != size ||
+        h->n_buckets == 0 ||
+        !_carr_fmap_section_ok(
+            h->disp_off, h->n_buckets, sizeof(uint32_t), size
+        ) ||
+        !_carr_fmap_section_ok(
+            h->slots_off, h->len, sizeof(CarrFMapSlot), size
+        ) ||
+        !_carr_fmap_section_ok(h->values_off, h->len, stride, size) ||
+        !_carr_fmap_section_ok(h->keys_off, 0, 1, size)
+    ) {
+        printf(
+            "%s:%d:ERROR: fmap_open: '%s' is not a frozen map\n",
+            __FILE_NAME__, __LINE__, path
+        );
+        munmap(base, st.st_size);
+        return false;
+    }
+
+    f->base         = (const uint8_t*)base;
+    f->size         = st.st_size;
+    f->header       = h;
+    f->disp         = (const uint32_t*)(f->base + h->disp_off);
+    f->slots        = (const CarrFMapSlot*)(f->base + h->slots_off);
+    f->values       = f->base + h->values_off;
+    f->keys         = (const char*)(f->base + h->keys_off);
+    f->keys_size    = size - h->keys_off;
+    f->value_stride = stride;
+    return true;
+}
+
+void carr_fmap_close(CarrFMap* f)
+{
+    if (f->base != NULL) {
+        munmap((void*)f->base, f->size);
+    }
+    *f = (CarrFMap){0};
+}
+
+const void* carr_fmap_nget(const CarrFMap* f, const char* key, size_t n)
+{
+    uint64_t len = f->header->len;
+    if (len == 0) {
+        return NULL;
+    }
+
+    uint64_t hash = CARR_MAP_HASH(key, n);
+    uint64_t b    = _carr_fmap_bucket(hash, f->header->n_buckets);
+    uint64_t s    = _carr_fmap_slot(hash, f->disp[b], len);
+
+    // The key offsets are only checked here, so a corrupt slot cannot
+    // send the comparison out of the file.
+    const CarrFMapSlot* slot = &f->slots[s];
+    if (
+        slot->hash != hash || slot->key_len != n ||
+        n > f->keys_size || slot->key_off > f->keys_size - n ||
+        memcmp(f->keys + slot->key_off, key, n) != 0
+    ) {
+        return NULL;
+    }
+    return f->values + s * f->value_stride;
+}
+
+const void* carr_fmap_get(const CarrFMap* f, const char* key)
+{
+    return carr_fmap_nget(f, key, strlen(key));
+}
+
+#endif // CARR_FMAP_IMPLEMENTATION
+
+#endif // CARR_FMAP_H_
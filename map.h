@@ -7,63 +7,707 @@
 #include <stdint.h>
 #include <string.h>
 
-// The user can define this macro to include only the functions 
+// The user can define this macro to include only the functions
 // with the 'carr_' prefix, as to avoid name collisions.
 // If this macro is not defined, all the versions without prefix
 // will also be included by default.
 #ifndef CARR_MAP_FORCE_PREFIX
 
-#define map_init     carr_map_init
-#define map_get      carr_map_get
-#define map_insert   carr_map_insert
-#define map_delete   carr_map_delete
-#define map_free     carr_map_free
-#define map_realloc  carr_map_realloc
+#define map_init       carr_map_init
+#define map_get        carr_map_get
+#define map_insert     carr_map_insert
+#define map_delete     carr_map_delete
+#define map_free       carr_map_free
+#define map_realloc    carr_map_realloc
+
+#define map_nget       carr_map_nget
+#define map_ninsert    carr_map_ninsert
+#define map_ndelete    carr_map_ndelete
+#define map_get_sv     carr_map_get_sv
+#define map_insert_sv  carr_map_insert_sv
+#define map_delete_sv  carr_map_delete_sv
+
+#define map_upsert     carr_map_upsert
+#define map_nupsert    carr_map_nupsert
+#define map_upsert_sv  carr_map_upsert_sv
+
+#define map_reserve        carr_map_reserve
+#define map_finish_resize  carr_map_finish_resize
+
+#define map_merge          carr_map_merge
+#define map_from_entries   carr_map_from_entries
+#define MapCombineFunction CarrMapCombineFunction
 
 #endif //CARR_MAP_WITH_PREFIX
 
+// Map, the typed maps and omap.h allocate through these. To use another
+// allocator, like arena.h, define all three before including this file.
+#ifndef CARR_MALLOC
+#define CARR_MALLOC(n)     malloc(n)
+#define CARR_REALLOC(p, n) realloc((p), (n))
+#define CARR_FREE(p)       free(p)
+#endif // CARR_MALLOC
+
+#if defined(__SSE2__) && !defined(CARR_MAP_NO_SIMD)
+#include <emmintrin.h>
+#define CARR_MAP_SSE2
+#endif
+
+// Must be a power of two (and at least CARR_MAP_GROUP_WIDTH).
+#define CARR_MAP_INITIAL_CAP     256
+#define CARR_MAP_LOAD_FACTOR     0.7
+
+// Number of slots of the old table moved to the new one by every map
+// operation while the map grows. 0 means the map is moved all at once.
+// Anything from 2 up guarantees the move is over before the next one.
+#ifndef CARR_MAP_REHASH_STEP
+#define CARR_MAP_REHASH_STEP     0
+#endif // CARR_MAP_REHASH_STEP
+
+#define CARR_MAP_GROUP_WIDTH     16
+#define CARR_MAP_CTRL_EMPTY      (uint8_t)0x80
+#define CARR_MAP_CTRL_DELETED    (uint8_t)0xFE
+#define carr_map_h1(hash)        ((hash) >> 7)
+#define carr_map_h2(hash)        (uint8_t)((hash) & 0x7F)
+
+/*-----------------------------------------------------------------------------+
+ *                                                                             *
+ *  Control bytes helpers, shared by Map and the typed maps generated by       *
+ *  CARR_MAP_DEFINE. A control array of a table with 'cap' slots has           *
+ *  cap + CARR_MAP_GROUP_WIDTH bytes: the last ones mirror the first ones,     *
+ *  so a group starting near the end of the table can be loaded at once        *
+ *  without wrapping around.                                                   *
+ *                                                                             *
+ +-----------------------------------------------------------------------------*/
+
+// Returns a bitmask with bit i set if group[i] == tag.
+static inline uint32_t _carr_map_group_match(const uint8_t* group, uint8_t tag)
+{
+#ifdef CARR_MAP_SSE2
+    __m128i g = _mm_loadu_si128((const __m128i*)group);
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8(tag)));
+#else
+    uint32_t mask = 0;
+    for (int i = 0; i < CARR_MAP_GROUP_WIDTH; ++i) {
+        mask |= (uint32_t)(group[i] == tag) << i;
+    }
+    return mask;
+#endif
+}
+
+// Returns a bitmask with bit i set if group[i] is empty or deleted,
+// which are exactly the control bytes with the high bit set.
+static inline uint32_t _carr_map_group_match_free(const uint8_t* group)
+{
+#ifdef CARR_MAP_SSE2
+    __m128i g = _mm_loadu_si128((const __m128i*)group);
+    return (uint32_t)_mm_movemask_epi8(g);
+#else
+    uint32_t mask = 0;
+    for (int i = 0; i < CARR_MAP_GROUP_WIDTH; ++i) {
+        mask |= (uint32_t)(group[i] >> 7) << i;
+    }
+    return mask;
+#endif
+}
+
+static inline void _carr_ctrl_set(
+    uint8_t* ctrl, size_t cap, size_t idx, uint8_t c
+) {
+    ctrl[idx] = c;
+    if (idx < CARR_MAP_GROUP_WIDTH) {
+        ctrl[cap + idx] = c;
+    }
+}
+
+// Finds the first free slot in the probe sequence of hash.
+static inline size_t _carr_ctrl_find_free(
+    const uint8_t* ctrl, size_t cap, uint64_t hash
+) {
+    size_t pos = carr_map_h1(hash) & (cap - 1);
+    for (;;) {
+        uint32_t mask = _carr_map_group_match_free(&ctrl[pos]);
+        if (mask != 0) {
+            return (pos + __builtin_ctz(mask)) & (cap - 1);
+        }
+        pos = (pos + CARR_MAP_GROUP_WIDTH) & (cap - 1);
+    }
+}
+
+// True if every window of CARR_MAP_GROUP_WIDTH slots around idx has an
+// empty slot. Then no probe sequence ever went past idx, and when its
+// entry is deleted the slot can be marked as empty instead of deleted.
+static inline bool _carr_ctrl_was_never_full(
+    const uint8_t* ctrl, size_t cap, size_t idx
+) {
+    size_t   before = (idx - CARR_MAP_GROUP_WIDTH) & (cap - 1);
+    uint32_t empty_before =
+        _carr_map_group_match(&ctrl[before], CARR_MAP_CTRL_EMPTY);
+    uint32_t empty_after =
+        _carr_map_group_match(&ctrl[idx], CARR_MAP_CTRL_EMPTY);
+    return empty_before != 0 && empty_after != 0 &&
+        __builtin_ctz(empty_after) +
+        (__builtin_clz(empty_before) - (32 - CARR_MAP_GROUP_WIDTH))
+            < CARR_MAP_GROUP_WIDTH;
+}
+
 typedef struct {
     const char* key;
     void*       value;
 } Entry;
 
+// Besides the entries, the map keeps one control byte per slot, in the
+// style of the Swiss tables: the high bit tells an empty or deleted slot
+// from a full one, and a full slot keeps the low 7 bits of its key hash.
+// Probing scans CARR_MAP_GROUP_WIDTH control bytes at a time (with SSE2
+// when available) and only looks at the entries whose tag matches.
+// The full hash and the length of every key are also kept, so growing
+// the map never needs to hash the keys again and comparing them never
+// needs a strlen. The length also tells whether the map owns the key
+// (see CARR_MAP_KEY_OWNED).
+// The items array keeps the same layout as before: free slots have a
+// NULL key, so iterating over items[0..cap] still works.
+// The capacity is always a power of two, so the slot of a hash is found
+// with a mask instead of a division.
+// Deleted slots are counted in 'tombstones' and count towards the load
+// factor. When they are what fills the map, they are dropped by
+// rehashing the map in place instead of growing it, so maps under steady
+// insert/delete churn keep short probe sequences.
+// When CARR_MAP_REHASH_STEP is not 0, growing is incremental: the old
+// table is kept in the old_* fields and each operation moves up to
+// CARR_MAP_REHASH_STEP of its slots to the new one, so no single
+// operation pays for moving the whole map. While that happens the items
+// array does not hold every entry: call carr_map_finish_resize before
+// iterating over it.
 typedef struct {
-    Entry* items;
-    size_t len;
-    size_t cap;
+    Entry*    items;
+    size_t    len;
+    size_t    cap;
+    uint8_t*  ctrl;
+    uint64_t* hashes;
+    size_t*   key_lens;
+    size_t    tombstones;
+
+    Entry*    old_items;
+    uint8_t*  old_ctrl;
+    uint64_t* old_hashes;
+    size_t*   old_key_lens;
+    size_t    old_cap;
+    size_t    migrated;
 } Map;
 
+// The hash function used by the map. The default one is a wyhash style
+// hash that consumes the key 8 bytes at a time. To use another one, e.g.
+// a randomly seeded hash for keys that may come from an adversary,
+// define this macro before including this file:
+//     #define CARR_MAP_HASH(data, n) carr_map_hash_bytes((data), (n), seed)
+// It must return a uint64_t and only depend on the n bytes of data.
+#ifndef CARR_MAP_HASH
+#define CARR_MAP_HASH(data, n) carr_map_hash_bytes((data), (n), 0)
+#endif // CARR_MAP_HASH
+
+uint64_t carr_map_hash_bytes(const void* data, size_t n, uint64_t seed);
+
+// Set in the stored length of a key when the map made the copy the key
+// points to, and so frees it along with the entry.
+#define CARR_MAP_KEY_OWNED       ((size_t)1 << (sizeof(size_t) * 8 - 1))
+#define carr_map_key_len(stored) ((stored) & ~CARR_MAP_KEY_OWNED)
+
+// Compares a key stored in the map, of stored length stored_n, against a
+// key of length n. Both are compared as bytes, so they can contain NULs.
+static inline bool _carr_map_key_eq(
+    const char* stored, size_t stored_n, const char* key, size_t n
+) {
+    return carr_map_key_len(stored_n) == n && memcmp(stored, key, n) == 0;
+}
+
 void carr_map_init(Map* m);
 void carr_map_get(Map* m, const char* key, Entry* e);
 void carr_map_insert(Map* m, Entry e);
 void carr_map_delete(Map* m, const char* key);
 
+// Makes room for n entries at once, so that inserting up to n entries
+// never needs to grow the map.
+void carr_map_reserve(Map* m, size_t n);
+// Moves what is left of the old table when the map is growing
+// incrementally. Does nothing otherwise.
+void carr_map_finish_resize(Map* m);
+
+// Called by carr_map_merge for the keys that are in both maps, it
+// returns the value to keep, e.g. the sum of two counters.
+typedef void*(*CarrMapCombineFunction)(
+    const char* key, void* dst_value, void* src_value
+);
+
+// Inserts every entry of src into dst. When a key is in both maps, the
+// value becomes combine(key, dst_value, src_value), or just src_value if
+// combine is NULL. dst is grown once up front and the hashes stored in
+// src are reused, so no key is hashed again.
+// The new entries of dst share their key pointers with src: src must
+// not free its keys while dst uses them.
+void carr_map_merge(Map* dst, Map* src, CarrMapCombineFunction combine);
+// Initializes m with the n given entries, sizing the table once. The
+// key pointers are stored as they are, and for repeated keys the last
+// entry wins.
+void carr_map_from_entries(Map* m, const Entry* entries, size_t n);
+
+// The 'n' versions take the key as a (pointer, length) pair, so it does
+// not need to be NUL-terminated and hashing it does not need a strlen.
+// Unlike carr_map_insert, which stores the key pointer given by the user,
+// carr_map_ninsert stores a malloc'd NUL-terminated copy of the key, but
+// only when the key is not in the map yet. Updating an existing key or
+// looking one up never allocates.
+// Who owns a key depends on how it got in: the map owns the copies made
+// by the 'n' and 'h' versions and frees them when their entry is deleted
+// or replaced by carr_map_insert, and in carr_map_free. The keys given to
+// carr_map_insert and carr_map_upsert stay the user's, who must keep them
+// alive while they are in the map and free them afterwards. The key of an
+// Entry returned by a lookup is only valid while the entry is there.
+void carr_map_nget(Map* m, const char* key, size_t n, Entry* e);
+void carr_map_ninsert(Map* m, const char* key, size_t n, void* value);
+void carr_map_ndelete(Map* m, const char* key, size_t n);
+
+// Wrappers to use a CarrStringView (see sv.h) as the key.
+// Any struct with the 'data' and 'len' fields will do.
+#define carr_map_get_sv(m, sv, e)                                              \
+    carr_map_nget((m), (sv).data, (sv).len, (e))
+#define carr_map_insert_sv(m, sv, value)                                       \
+    carr_map_ninsert((m), (sv).data, (sv).len, (value))
+#define carr_map_delete_sv(m, sv)                                              \
+    carr_map_ndelete((m), (sv).data, (sv).len)
+
+// Get-or-insert in a single probe walk. Returns a pointer to the value of
+// key, which is NULL if the key was just inserted, so the typical counter
+// update looks like:
+//     void** slot = map_upsert_sv(&m, word);
+//     if (*slot == NULL) *slot = calloc(1, sizeof(int));
+//     *(int*)*slot += 1;
+// The pointer is only valid until the next insertion in the map.
+// As with insert/ninsert, carr_map_upsert stores the key pointer as is,
+// while carr_map_nupsert stores a copy of the key when it inserts it.
+void** carr_map_upsert(Map* m, const char* key);
+void** carr_map_nupsert(Map* m, const char* key, size_t n);
+
+#define carr_map_upsert_sv(m, sv)                                              \
+    carr_map_nupsert((m), (sv).data, (sv).len)
+
+// The 'h' versions also take the hash of the key, which must be
+// CARR_MAP_HASH(key, n), for callers that already had to hash the key
+// for something else, e.g. to pick a shard in cmap.h.
+void   carr_map_hget(Map* m, const char* key, size_t n, uint64_t hash, Entry* e);
+void** carr_map_hupsert(Map* m, const char* key, size_t n, uint64_t hash);
+void   carr_map_hdelete(Map* m, const char* key, size_t n, uint64_t hash);
+
+
+/*-----------------------------------------------------------------------------+
+ *                                                                             *
+ *                           TYPED MAPS                                        *
+ *                                                                             *
+ +-----------------------------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------------+
+ *                                                                             *
+ *  CARR_MAP_DEFINE(Name, K, V, hash, eq) generates a map from K to V with     *
+ *  the values stored inline in the slots, in the form:                        *
+ *  typedef struct { K key; V value; } NameItem;                               *
+ *  typedef struct {                                                           *
+ *       NameItem* items                                                       *
+ *       size_t    len                                                         *
+ *       size_t    cap                                                         *
+ *       uint8_t*  ctrl                                                        *
+ *       size_t    tombstones                                                  *
+ *  } Name;                                                                    *
+ *  and the functions:                                                         *
+ *  Name_init, Name_free, Name_get, Name_upsert, Name_insert, Name_delete      *
+ *  'hash' must turn a K into a uint64_t and 'eq' compare two Ks. They can     *
+ *  be functions or macros, and get inlined in the generated code.             *
+ *  The keys are stored as they are given: a StringView key keeps pointing     *
+ *  to the user's buffer. The slot i holds an entry iff                        *
+ *  carr_map_slot_full(m, i), so iterating looks like:                         *
+ *  for (size_t i = 0; i < m.cap; ++i)                                         *
+ *      if (carr_map_slot_full(&m, i)) use(m.items[i]);                        *
+ *  The file [examples/12-word_counter_typed.c] provides a complete example.   *
+ *                                                                             *
+ +-----------------------------------------------------------------------------*/
+
+#define carr_map_slot_full(m, i) (((m)->ctrl[(i)] & 0x80) == 0)
+
+// Ready-made hash and eq for the common key types.
+#define carr_map_sv_hash(sv)  CARR_MAP_HASH((sv).data, (sv).len)
+#define carr_map_sv_eq(a, b)                                                   \
+    ((a).len == (b).len && memcmp((a).data, (b).data, (a).len) == 0)
+#define carr_map_int_hash(x)  carr_map_hash_u64((uint64_t)(x))
+#define carr_map_int_eq(a, b) ((a) == (b))
+
+// splitmix64 finalizer, a cheap and good enough mix for integer keys.
+static inline uint64_t carr_map_hash_u64(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    return x;
+}
+
+#define CARR_MAP_DEFINE(Name, K, V, hash, eq)                                  \
+typedef struct {                                                               \
+    K key;                                                                     \
+    V value;                                                                   \
+} Name##Item;                                                                  \
+                                                                               \
+typedef struct {                                                               \
+    Name##Item* items;                                                         \
+    size_t      len;                                                           \
+    size_t      cap;                                                           \
+    uint8_t*    ctrl;                                                          \
+    size_t      tombstones;                                                    \
+} Name;                                                                        \
+                                                                               \
+static inline void Name##_rehash(Name* m, size_t new_cap)                      \
+{                                                                              \
+    Name old = *m;                                                             \
+                                                                               \
+    m->cap        = new_cap;                                                   \
+    m->tombstones = 0;                                                         \
+    m->items      = (Name##Item*)CARR_MALLOC(new_cap * sizeof(Name##Item));    \
+    m->ctrl       = (uint8_t*)CARR_MALLOC(new_cap + CARR_MAP_GROUP_WIDTH);     \
+    memset(m->ctrl, CARR_MAP_CTRL_EMPTY, new_cap + CARR_MAP_GROUP_WIDTH);      \
+                                                                               \
+    for (size_t i = 0; i < old.cap; ++i) {                                     \
+        if (!carr_map_slot_full(&old, i)) {                                    \
+            continue;                                                          \
+        }                                                                      \
+        uint64_t h   = hash(old.items[i].key);                                 \
+        size_t   idx = _carr_ctrl_find_free(m->ctrl, m->cap, h);               \
+        m->items[idx] = old.items[i];                                          \
+        _carr_ctrl_set(m->ctrl, m->cap, idx, carr_map_h2(h));                  \
+    }                                                                          \
+    CARR_FREE(old.items);                                                      \
+    CARR_FREE(old.ctrl);                                                       \
+}                                                                              \
+                                                                               \
+static inline void Name##_init(Name* m)                                        \
+{                                                                              \
+    *m = (Name){0};                                                            \
+    Name##_rehash(m, CARR_MAP_INITIAL_CAP);                                    \
+}                                                                              \
+                                                                               \
+static inline void Name##_free(Name* m)                                        \
+{                                                                              \
+    CARR_FREE(m->items);                                                       \
+    CARR_FREE(m->ctrl);                                                        \
+    *m = (Name){0};                                                            \
+}                                                                              \
+                                                                               \
+static inline size_t Name##_probe(Name* m, K key, uint64_t h, bool* found)     \
+{                                                                              \
+    size_t  pos      = carr_map_h1(h) & (m->cap - 1);                          \
+    size_t  free_idx = m->cap;                                                 \
+    uint8_t tag      = carr_map_h2(h);                                         \
+    for (size_t i = 0; i < m->cap; i += CARR_MAP_GROUP_WIDTH) {                \
+        const uint8_t* group = &m->ctrl[pos];                                  \
+                                                                               \
+        uint32_t mask = _carr_map_group_match(group, tag);                     \
+        while (mask != 0) {                                                    \
+            size_t idx = (pos + __builtin_ctz(mask)) & (m->cap - 1);           \
+            if (eq(m->items[idx].key, key)) {                                  \
+                *found = true;                                                 \
+                return idx;                                                    \
+            }                                                                  \
+            mask &= mask - 1;                                                  \
+        }                                                                      \
+                                                                               \
+        uint32_t free_mask = _carr_map_group_match_free(group);                \
+        if (free_idx == m->cap && free_mask != 0) {                            \
+            free_idx = (pos + __builtin_ctz(free_mask)) & (m->cap - 1);        \
+        }                                                                      \
+        if (_carr_map_group_match(group, CARR_MAP_CTRL_EMPTY) != 0) {          \
+            break;                                                             \
+        }                                                                      \
+        pos = (pos + CARR_MAP_GROUP_WIDTH) & (m->cap - 1);                     \
+    }                                                                          \
+    *found = false;                                                            \
+    return free_idx;                                                           \
+}                                                                              \
+                                                                               \
+/* Returns a pointer to the value of key, or NULL if it is not in the map. */  \
+static inline V* Name##_get(Name* m, K key)                                    \
+{                                                                              \
+    bool found;                                                                \
+    size_t idx = Name##_probe(m, key, hash(key), &found);                      \
+    return found ? &m->items[idx].value : NULL;                                \
+}                                                                              \
+                                                                               \
+/* Returns a pointer to the value of key, inserting it first with a        */  \
+/* zeroed value if needed. Valid until the next insertion in the map.      */  \
+static inline V* Name##_upsert(Name* m, K key)                                 \
+{                                                                              \
+    if (m->len + m->tombstones + 1 >= m->cap * CARR_MAP_LOAD_FACTOR) {         \
+        bool cleanup = m->tombstones > 0 &&                                    \
+            4 * (m->len + 1) < 3 * m->cap * CARR_MAP_LOAD_FACTOR;              \
+        Name##_rehash(m, cleanup ? m->cap : m->cap * 2);                       \
+    }                                                                          \
+                                                                               \
+    bool found;                                                                \
+    uint64_t h   = hash(key);                                                  \
+    size_t   idx = Name##_probe(m, key, h, &found);                            \
+    if (!found) {                                                              \
+        if (m->ctrl[idx] == CARR_MAP_CTRL_DELETED) {                           \
+            m->tombstones--;                                                   \
+        }                                                                      \
+        m->items[idx].key = key;                                               \
+        memset(&m->items[idx].value, 0, sizeof(V));                            \
+        _carr_ctrl_set(m->ctrl, m->cap, idx, carr_map_h2(h));                  \
+        m->len++;                                                              \
+    }                                                                          \
+    return &m->items[idx].value;                                               \
+}                                                                              \
+                                                                               \
+static inline void Name##_insert(Name* m, K key, V value)                      \
+{                                                                              \
+    *Name##_upsert(m, key) = value;                                            \
+}                                                                              \
+                                                                               \
+/* Returns true if key was in the map. */                                      \
+static inline bool Name##_delete(Name* m, K key)                               \
+{                                                                              \
+    bool found;                                                                \
+    size_t idx = Name##_probe(m, key, hash(key), &found);                      \
+    if (!found) {                                                              \
+        return false;                                                          \
+    }                                                                          \
+    m->len--;                                                                  \
+    if (_carr_ctrl_was_never_full(m->ctrl, m->cap, idx)) {                     \
+        _carr_ctrl_set(m->ctrl, m->cap, idx, CARR_MAP_CTRL_EMPTY);             \
+    } else {                                                                   \
+        _carr_ctrl_set(m->ctrl, m->cap, idx, CARR_MAP_CTRL_DELETED);           \
+        m->tombstones++;                                                       \
+    }                                                                          \
+    return true;                                                               \
+}
+
 #ifdef CARR_MAP_IMPLEMENTATION
 
-#define CARR_MAP_INITIAL_CAP     256
-#define CARR_MAP_LOAD_FACTOR     0.7
 #define CARR_MAP_TOMBSTONE_VALUE (void*)1
 #define CARR_MAP_TOMBSTONE       (Entry){ NULL, CARR_MAP_TOMBSTONE_VALUE }
 
 
-uint32_t _carr_hash(const char* chars)
+#define CARR_MAP_HASH_P0 0xa0761d6478bd642full
+#define CARR_MAP_HASH_P1 0xe7037ed1a0b428dbull
+
+// Multiplies a and b into 128 bits and folds the result back into 64.
+uint64_t _carr_map_mum(uint64_t a, uint64_t b)
 {
-    uint32_t FNV_prime = 16777619;
-    uint32_t hash = 2166136261;
-    size_t n = strlen(chars);
-    for (size_t i = 0; i < n; i++) {
-        hash = hash * FNV_prime;
-        hash = hash ^ chars[i];
+#ifdef __SIZEOF_INT128__
+    __uint128_t r = (__uint128_t)a * b;
+    return (uint64_t)r ^ (uint64_t)(r >> 64);
+#else
+    uint64_t ha = a >> 32, la = (uint32_t)a;
+    uint64_t hb = b >> 32, lb = (uint32_t)b;
+    uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    uint64_t t  = rl + (rm0 << 32);
+    uint64_t c  = t < rl;
+    uint64_t lo = t + (rm1 << 32);
+    c += lo < t;
+    uint64_t hi = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+    return lo ^ hi;
+#endif
+}
+
+uint64_t _carr_map_read64(const uint8_t* p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+uint64_t _carr_map_read32(const uint8_t* p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+uint64_t carr_map_hash_bytes(const void* data, size_t n, uint64_t seed)
+{
+    const uint8_t* p = (const uint8_t*)data;
+    uint64_t h = seed ^ _carr_map_mum(seed ^ CARR_MAP_HASH_P0, CARR_MAP_HASH_P1);
+    uint64_t a, b;
+
+    if (n <= 16) {
+        if (n >= 4) {
+            // Two pairs of (possibly overlapping) 4 byte reads cover
+            // every byte of keys between 4 and 16 bytes long.
+            size_t off = (n >> 3) << 2;
+            a = (_carr_map_read32(p) << 32) | _carr_map_read32(p + off);
+            b = (_carr_map_read32(p + n - 4) << 32)
+              | _carr_map_read32(p + n - 4 - off);
+        } else if (n > 0) {
+            a = ((uint64_t)p[0] << 16) | ((uint64_t)p[n >> 1] << 8) | p[n - 1];
+            b = 0;
+        } else {
+            a = 0;
+            b = 0;
+        }
+    } else {
+        size_t left = n;
+        while (left > 16) {
+            h = _carr_map_mum(
+                _carr_map_read64(p) ^ CARR_MAP_HASH_P1,
+                _carr_map_read64(p + 8) ^ h
+            );
+            p    += 16;
+            left -= 16;
+        }
+        a = _carr_map_read64(p + left - 16);
+        b = _carr_map_read64(p + left - 8);
+    }
+
+    h = _carr_map_mum(a ^ CARR_MAP_HASH_P1, b ^ h);
+    return _carr_map_mum(h ^ CARR_MAP_HASH_P0 ^ n, CARR_MAP_HASH_P1);
+}
+
+void _carr_map_set_ctrl(Map* m, size_t idx, uint8_t c)
+{
+    _carr_ctrl_set(m->ctrl, m->cap, idx, c);
+}
+
+// Finds a free slot for a key that is known not to be in the map.
+size_t _carr_map_find_free(Map* m, uint64_t hash)
+{
+    return _carr_ctrl_find_free(m->ctrl, m->cap, hash);
+}
+
+// Frees the keys the map owns in the cap slots of a table.
+void _carr_map_free_keys(
+    const uint8_t* ctrl, const Entry* items, const size_t* key_lens,
+    size_t cap
+) {
+    for (size_t i = 0; i < cap; ++i) {
+        if ((ctrl[i] & 0x80) == 0 && (key_lens[i] & CARR_MAP_KEY_OWNED)) {
+            CARR_FREE((void*)items[i].key);
+        }
     }
-    return hash;
 }
 
 void carr_map_free(Map *m)
 {
-    free(m->items);
+    if (m->items != NULL) {
+        _carr_map_free_keys(m->ctrl, m->items, m->key_lens, m->cap);
+    }
+    if (m->old_items != NULL) {
+        _carr_map_free_keys(
+            m->old_ctrl, m->old_items, m->old_key_lens, m->old_cap
+        );
+    }
+    CARR_FREE(m->items);
+    CARR_FREE(m->ctrl);
+    CARR_FREE(m->hashes);
+    CARR_FREE(m->key_lens);
+    CARR_FREE(m->old_items);
+    CARR_FREE(m->old_ctrl);
+    CARR_FREE(m->old_hashes);
+    CARR_FREE(m->old_key_lens);
     *m = (Map){0};
 }
 
+// Points the map to new empty arrays of cap slots.
+void _carr_map_alloc_table(Map* m, size_t cap)
+{
+    m->cap        = cap;
+    m->tombstones = 0;
+    m->items      = (Entry*)CARR_MALLOC(cap * sizeof(m->items[0]));
+    m->hashes     = (uint64_t*)CARR_MALLOC(cap * sizeof(m->hashes[0]));
+    m->key_lens   = (size_t*)CARR_MALLOC(cap * sizeof(m->key_lens[0]));
+    m->ctrl       = (uint8_t*)CARR_MALLOC(cap + CARR_MAP_GROUP_WIDTH);
+    memset(m->items, 0, cap * sizeof(m->items[0]));
+    memset(m->ctrl, CARR_MAP_CTRL_EMPTY, cap + CARR_MAP_GROUP_WIDTH);
+}
+
+// Fills the free slot idx, without touching len.
+void _carr_map_fill(Map* m, size_t idx, uint64_t hash, size_t n, Entry e)
+{
+    if (m->ctrl[idx] == CARR_MAP_CTRL_DELETED) {
+        m->tombstones--;
+    }
+    m->items[idx]    = e;
+    m->hashes[idx]   = hash;
+    m->key_lens[idx] = n;
+    _carr_map_set_ctrl(m, idx, carr_map_h2(hash));
+}
+
+// Moves up to 'steps' slots of the old table to the new one, and frees
+// the old table once it is empty. Moved slots are marked as deleted, so
+// lookups in the old table still walk past them.
+void _carr_map_migrate(Map* m, size_t steps)
+{
+    if (m->old_items == NULL) {
+        return;
+    }
+
+    size_t end = m->migrated + steps;
+    if (end > m->old_cap) {
+        end = m->old_cap;
+    }
+    for (size_t i = m->migrated; i < end; ++i) {
+        if (m->old_ctrl[i] & 0x80) {
+            continue;
+        }
+        uint64_t hash = m->old_hashes[i];
+        _carr_map_fill(
+            m, _carr_map_find_free(m, hash), hash, m->old_key_lens[i],
+            m->old_items[i]
+        );
+        _carr_ctrl_set(m->old_ctrl, m->old_cap, i, CARR_MAP_CTRL_DELETED);
+    }
+    m->migrated = end;
+
+    if (m->migrated == m->old_cap) {
+        CARR_FREE(m->old_items);
+        CARR_FREE(m->old_ctrl);
+        CARR_FREE(m->old_hashes);
+        CARR_FREE(m->old_key_lens);
+        m->old_items    = NULL;
+        m->old_ctrl     = NULL;
+        m->old_hashes   = NULL;
+        m->old_key_lens = NULL;
+        m->old_cap      = 0;
+        m->migrated     = 0;
+    }
+}
+
+void carr_map_finish_resize(Map* m)
+{
+    _carr_map_migrate(m, m->old_cap);
+}
+
+// Moves every entry to new arrays of new_cap slots at once.
+void _carr_map_rehash(Map* m, size_t new_cap)
+{
+    carr_map_finish_resize(m);
+
+    Map old = *m;
+    _carr_map_alloc_table(m, new_cap);
+
+    // The keys are all different and their hashes are known, so moving
+    // them only needs to find a free slot for each one.
+    for (size_t i = 0; i < old.cap; ++i) {
+        if (old.ctrl[i] & 0x80) {
+            continue;
+        }
+        uint64_t hash = old.hashes[i];
+        _carr_map_fill(
+            m, _carr_map_find_free(m, hash), hash, old.key_lens[i],
+            old.items[i]
+        );
+    }
+    CARR_FREE(old.items);
+    CARR_FREE(old.ctrl);
+    CARR_FREE(old.hashes);
+    CARR_FREE(old.key_lens);
+}
+
 void carr_map_realloc(Map* m)
 {
     size_t new_cap;
@@ -73,90 +717,400 @@ void carr_map_realloc(Map* m)
         new_cap = CARR_MAP_INITIAL_CAP;
     }
 
-    Map old = *m;
+    if (CARR_MAP_REHASH_STEP == 0 || m->len == 0) {
+        _carr_map_rehash(m, new_cap);
+        return;
+    }
 
-    m->cap = new_cap;
-    m->items = (Entry*)malloc(sizeof(m->items[0]) * new_cap);
-    for (size_t i = 0; i < old.cap; ++i) {
-        Entry item = old.items[i];
-        if (item.key == NULL) {
+    carr_map_finish_resize(m);
+    m->old_items    = m->items;
+    m->old_ctrl     = m->ctrl;
+    m->old_hashes   = m->hashes;
+    m->old_key_lens = m->key_lens;
+    m->old_cap      = m->cap;
+    m->migrated     = 0;
+    _carr_map_alloc_table(m, new_cap);
+}
+
+// The smallest capacity, doubling from cap, that holds n entries
+// without going over the load factor.
+size_t _carr_map_cap_for(size_t n, size_t cap)
+{
+    while (n + 1 >= cap * CARR_MAP_LOAD_FACTOR) {
+        cap *= 2;
+    }
+    return cap;
+}
+
+void carr_map_reserve(Map* m, size_t n)
+{
+    size_t new_cap = _carr_map_cap_for(
+        n, m->cap > 0 ? m->cap : CARR_MAP_INITIAL_CAP
+    );
+    if (new_cap != m->cap) {
+        _carr_map_rehash(m, new_cap);
+    }
+}
+
+// Index of the group of pos in the probe sequence that starts at the
+// home slot of hash.
+size_t _carr_map_probe_index(Map* m, size_t pos, uint64_t hash)
+{
+    size_t home = carr_map_h1(hash) & (m->cap - 1);
+    return ((pos - home) & (m->cap - 1)) / CARR_MAP_GROUP_WIDTH;
+}
+
+// Drops all the tombstones without allocating, following the
+// 'drop deleted without resize' algorithm of the Swiss tables:
+// every full slot is first marked as deleted and every deleted slot as
+// empty, then each entry still marked as deleted is moved to the first
+// free slot of its probe sequence, swapping places with entries that
+// were not processed yet.
+void _carr_map_drop_tombstones(Map* m)
+{
+    for (size_t i = 0; i < m->cap; ++i) {
+        if (m->ctrl[i] == CARR_MAP_CTRL_DELETED) {
+            m->ctrl[i]  = CARR_MAP_CTRL_EMPTY;
+            m->items[i] = (Entry){0};
+        } else if (m->ctrl[i] != CARR_MAP_CTRL_EMPTY) {
+            m->ctrl[i]  = CARR_MAP_CTRL_DELETED;
+        }
+    }
+    memcpy(&m->ctrl[m->cap], m->ctrl, CARR_MAP_GROUP_WIDTH);
+
+    for (size_t i = 0; i < m->cap; ++i) {
+        if (m->ctrl[i] != CARR_MAP_CTRL_DELETED) {
             continue;
         }
-        map_insert(m, item);
+        uint64_t hash   = m->hashes[i];
+        size_t   target = _carr_map_find_free(m, hash);
+
+        // Already in the right group, it can stay where it is.
+        if (
+            _carr_map_probe_index(m, target, hash) ==
+            _carr_map_probe_index(m, i, hash)
+        ) {
+            _carr_map_set_ctrl(m, i, carr_map_h2(hash));
+            continue;
+        }
+
+        if (m->ctrl[target] == CARR_MAP_CTRL_EMPTY) {
+            m->items[target]    = m->items[i];
+            m->hashes[target]   = hash;
+            m->key_lens[target] = m->key_lens[i];
+            _carr_map_set_ctrl(m, target, carr_map_h2(hash));
+            m->items[i] = (Entry){0};
+            _carr_map_set_ctrl(m, i, CARR_MAP_CTRL_EMPTY);
+        } else {
+            // The target holds an entry that still needs to be placed,
+            // swap them and process slot i again.
+            Entry    item = m->items[target];
+            uint64_t h    = m->hashes[target];
+            size_t   n    = m->key_lens[target];
+            m->items[target]    = m->items[i];
+            m->hashes[target]   = hash;
+            m->key_lens[target] = m->key_lens[i];
+            _carr_map_set_ctrl(m, target, carr_map_h2(hash));
+            m->items[i]    = item;
+            m->hashes[i]   = h;
+            m->key_lens[i] = n;
+            --i;
+        }
+    }
+    m->tombstones = 0;
+}
+
+// Makes sure there is room for one more entry, either by dropping the
+// tombstones, when the live entries alone fill less than 3/4 of the load
+// factor (so each cleanup frees a good fraction of the table), or by
+// growing the map.
+void _carr_map_make_room(Map* m)
+{
+    if (m->len + m->tombstones + 1 < m->cap * CARR_MAP_LOAD_FACTOR) {
+        return;
+    }
+    if (
+        m->tombstones > 0 &&
+        4 * (m->len + 1) < 3 * m->cap * CARR_MAP_LOAD_FACTOR
+    ) {
+        _carr_map_drop_tombstones(m);
+    } else {
+        carr_map_realloc(m);
     }
-    map_free(&old);
 }
 
 void carr_map_init(Map* m)
 {
     *m = (Map){0};
-    map_realloc(m);
+    carr_map_realloc(m);
     // *m->items = (Entry){0};
     // m->cap   = 0;
     // m->len   = 0;
 }
 
 
-void carr_map_get(Map* m, const char* key, Entry* e)
+// Walks the probe sequence of key exactly once, a group at a time.
+// If key is in the map, sets found and returns its slot. Otherwise
+// returns the slot where it should go, which is the first deleted
+// slot in the sequence, if any.
+// The table is given by its arrays so the old table of a map that is
+// growing incrementally can be searched as well.
+size_t _carr_map_probe_table(
+    const uint8_t* ctrl, const Entry* items, const uint64_t* hashes,
+    const size_t* key_lens, size_t cap, const char* key, size_t n,
+    uint64_t hash, bool* found
+) {
+    size_t  pos      = carr_map_h1(hash) & (cap - 1);
+    size_t  free_idx = cap;
+    uint8_t tag      = carr_map_h2(hash);
+    for (size_t i = 0; i < cap; i += CARR_MAP_GROUP_WIDTH) {
+        const uint8_t* group = &ctrl[pos];
+
+        uint32_t mask = _carr_map_group_match(group, tag);
+        while (mask != 0) {
+            size_t idx = (pos + __builtin_ctz(mask)) & (cap - 1);
+            if (
+                hashes[idx] == hash &&
+                _carr_map_key_eq(items[idx].key, key_lens[idx], key, n)
+            ) {
+                *found = true;
+                return idx;
+            }
+            mask &= mask - 1;
+        }
+
+        uint32_t free_mask = _carr_map_group_match_free(group);
+        if (free_idx == cap && free_mask != 0) {
+            free_idx = (pos + __builtin_ctz(free_mask)) & (cap - 1);
+        }
+        if (_carr_map_group_match(group, CARR_MAP_CTRL_EMPTY) != 0) {
+            break;
+        }
+        pos = (pos + CARR_MAP_GROUP_WIDTH) & (cap - 1);
+    }
+    *found = false;
+    return free_idx;
+}
+
+size_t _carr_map_probe(
+    Map* m, const char* key, size_t n, uint64_t hash, bool* found
+) {
+    return _carr_map_probe_table(
+        m->ctrl, m->items, m->hashes, m->key_lens, m->cap, key, n, hash,
+        found
+    );
+}
+
+size_t _carr_map_probe_old(
+    Map* m, const char* key, size_t n, uint64_t hash, bool* found
+) {
+    return _carr_map_probe_table(
+        m->old_ctrl, m->old_items, m->old_hashes, m->old_key_lens,
+        m->old_cap, key, n, hash, found
+    );
+}
+
+// Fills a free slot returned by _carr_map_probe with a new entry, whose
+// key is n bytes long.
+void _carr_map_put(Map* m, size_t idx, uint64_t hash, size_t n, Entry e)
 {
-    uint32_t idx = _carr_hash(key) % m->cap;
-    Entry cur;
-    cur = m->items[idx];
-    while (
-        (cur.key != NULL && strcmp(cur.key, key) != 0)
-        || (cur.key == NULL && cur.value == CARR_MAP_TOMBSTONE_VALUE)
-    ) {
-        idx = (idx + 1) % m->cap;
-        cur = m->items[idx];
+    _carr_map_fill(m, idx, hash, n, e);
+    m->len++;
+}
+
+// Finds the slot of key in the (new) table, ready to be written to.
+// If the map is growing and key is still in the old table, it is moved
+// to the new table first.
+size_t _carr_map_find_slot(
+    Map* m, const char* key, size_t n, uint64_t hash, bool* found
+) {
+    _carr_map_make_room(m);
+    _carr_map_migrate(m, CARR_MAP_REHASH_STEP);
+
+    size_t idx = _carr_map_probe(m, key, n, hash, found);
+    if (*found || m->old_items == NULL) {
+        return idx;
+    }
+
+    size_t old_idx = _carr_map_probe_old(m, key, n, hash, found);
+    if (*found) {
+        _carr_map_fill(
+            m, idx, hash, m->old_key_lens[old_idx], m->old_items[old_idx]
+        );
+        _carr_ctrl_set(m->old_ctrl, m->old_cap, old_idx, CARR_MAP_CTRL_DELETED);
     }
-    if (cur.key == NULL) {
-        *e = (Entry){ NULL, NULL };
+    return idx;
+}
+
+void carr_map_hget(Map* m, const char* key, size_t n, uint64_t hash, Entry* e)
+{
+    _carr_map_migrate(m, CARR_MAP_REHASH_STEP);
+
+    bool found;
+    size_t idx = _carr_map_probe(m, key, n, hash, &found);
+    if (found) {
+        *e = m->items[idx];
         return;
     }
-    *e = cur;
+    if (m->old_items != NULL) {
+        idx = _carr_map_probe_old(m, key, n, hash, &found);
+        if (found) {
+            *e = m->old_items[idx];
+            return;
+        }
+    }
+    *e = (Entry){ NULL, NULL };
+}
+
+void carr_map_nget(Map* m, const char* key, size_t n, Entry* e)
+{
+    carr_map_hget(m, key, n, CARR_MAP_HASH(key, n), e);
+}
+
+void carr_map_get(Map* m, const char* key, Entry* e)
+{
+    carr_map_nget(m, key, strlen(key), e);
 }
 
 void carr_map_insert(Map* m, Entry e)
 {
-    if (m->len + 1 >= m->cap * CARR_MAP_LOAD_FACTOR) {
-        map_realloc(m);
+    bool found;
+    size_t   n    = strlen(e.key);
+    uint64_t hash = CARR_MAP_HASH(e.key, n);
+    size_t   idx  = _carr_map_find_slot(m, e.key, n, hash, &found);
+    if (found) {
+        // The new key pointer replaces the stored one, which is freed if
+        // it was a copy.
+        if (m->key_lens[idx] & CARR_MAP_KEY_OWNED) {
+            CARR_FREE((void*)m->items[idx].key);
+        }
+        m->items[idx]    = e;
+        m->key_lens[idx] = n;
+        return;
     }
+    _carr_map_put(m, idx, hash, n, e);
+}
 
-    uint32_t idx = _carr_hash(e.key) % m->cap;
-    Entry exists = {0};
-    map_get(m, e.key, &exists);
+void carr_map_merge(Map* dst, Map* src, CarrMapCombineFunction combine)
+{
+    carr_map_finish_resize(src);
+    carr_map_reserve(dst, dst->len + src->len);
 
-    Entry* cur;
-    cur = &(m->items[idx]);
-    if (exists.key == NULL && exists.value == NULL) {
-        while (cur->key != NULL) {
-            idx = (idx + 1) % m->cap;
-            cur = &(m->items[idx]);
+    for (size_t i = 0; i < src->cap; ++i) {
+        if (src->ctrl[i] & 0x80) {
+            continue;
         }
-        m->len++;
-    } else {
-        while (strcmp(cur->key, e.key) != 0) {
-            idx = (idx + 1) % m->cap;
-            cur = &(m->items[idx]);
+        Entry    e    = src->items[i];
+        uint64_t hash = src->hashes[i];
+        // dst only borrows the keys that src owns.
+        size_t   n    = carr_map_key_len(src->key_lens[i]);
+
+        bool   found;
+        size_t idx = _carr_map_find_slot(dst, e.key, n, hash, &found);
+        if (!found) {
+            _carr_map_put(dst, idx, hash, n, e);
+        } else if (combine != NULL) {
+            Entry* cur = &dst->items[idx];
+            cur->value = combine(cur->key, cur->value, e.value);
+        } else {
+            dst->items[idx].value = e.value;
         }
     }
-    m->items[idx] = e;  
 }
 
-void carr_map_delete(Map* m, const char* key)
+void carr_map_from_entries(Map* m, const Entry* entries, size_t n)
 {
-    uint32_t idx = _carr_hash(key) % m->cap;
-    Entry cur;
-    cur = (m->items[idx]);
-    while (cur.key != NULL && strcmp(cur.key, key) != 0) {
-        idx = (idx + 1) % m->cap;
-        cur = (m->items[idx]);
+    // Allocates the final table directly, instead of the default one of
+    // carr_map_init followed by a rehash.
+    *m = (Map){0};
+    _carr_map_alloc_table(m, _carr_map_cap_for(n, CARR_MAP_INITIAL_CAP));
+    for (size_t i = 0; i < n; ++i) {
+        carr_map_insert(m, entries[i]);
     }
-    if (cur.key == NULL) {
+}
+
+void carr_map_ninsert(Map* m, const char* key, size_t n, void* value)
+{
+    *carr_map_nupsert(m, key, n) = value;
+}
+
+void** carr_map_upsert(Map* m, const char* key)
+{
+    bool found;
+    size_t   n    = strlen(key);
+    uint64_t hash = CARR_MAP_HASH(key, n);
+    size_t   idx  = _carr_map_find_slot(m, key, n, hash, &found);
+    if (!found) {
+        _carr_map_put(m, idx, hash, n, (Entry){ key, NULL });
+    }
+    return &m->items[idx].value;
+}
+
+void** carr_map_hupsert(Map* m, const char* key, size_t n, uint64_t hash)
+{
+    bool found;
+    size_t idx = _carr_map_find_slot(m, key, n, hash, &found);
+    if (!found) {
+        char* copy = (char*)CARR_MALLOC((n + 1) * sizeof(char));
+        memcpy(copy, key, n);
+        copy[n] = '\0';
+        _carr_map_put(
+            m, idx, hash, n | CARR_MAP_KEY_OWNED, (Entry){ copy, NULL }
+        );
+    }
+    return &m->items[idx].value;
+}
+
+void** carr_map_nupsert(Map* m, const char* key, size_t n)
+{
+    return carr_map_hupsert(m, key, n, CARR_MAP_HASH(key, n));
+}
+
+void carr_map_hdelete(Map* m, const char* key, size_t n, uint64_t hash)
+{
+    _carr_map_migrate(m, CARR_MAP_REHASH_STEP);
+
+    bool found;
+    size_t idx = _carr_map_probe(m, key, n, hash, &found);
+    if (!found) {
+        if (m->old_items == NULL) {
+            return;
+        }
+        idx = _carr_map_probe_old(m, key, n, hash, &found);
+        if (found) {
+            m->len--;
+            if (m->old_key_lens[idx] & CARR_MAP_KEY_OWNED) {
+                CARR_FREE((void*)m->old_items[idx].key);
+            }
+            m->old_items[idx] = CARR_MAP_TOMBSTONE;
+            _carr_ctrl_set(m->old_ctrl, m->old_cap, idx, CARR_MAP_CTRL_DELETED);
+        }
         return;
     }
     m->len--;
+    if (m->key_lens[idx] & CARR_MAP_KEY_OWNED) {
+        CARR_FREE((void*)m->items[idx].key);
+    }
+
+    if (_carr_ctrl_was_never_full(m->ctrl, m->cap, idx)) {
+        m->items[idx] = (Entry){0};
+        _carr_map_set_ctrl(m, idx, CARR_MAP_CTRL_EMPTY);
+        return;
+    }
+
     m->items[idx] = CARR_MAP_TOMBSTONE;
+    _carr_map_set_ctrl(m, idx, CARR_MAP_CTRL_DELETED);
+    m->tombstones++;
+}
+
+void carr_map_ndelete(Map* m, const char* key, size_t n)
+{
+    carr_map_hdelete(m, key, n, CARR_MAP_HASH(key, n));
+}
+
+void carr_map_delete(Map* m, const char* key)
+{
+    carr_map_ndelete(m, key, strlen(key));
 }
 
 #endif // CARR_MAP_IMPLEMENTATION
@@ -0,0 +1,223 @@
+#ifndef CARR_MQUEUE_H_
+#define CARR_MQUEUE_H_
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "vec.h"
+
+// A priority queue that can be shared between threads, as a MultiQueue
+// (Rihani, Sanders and Dementiev, "MultiQueues: Simple Relaxed Concurrent
+// Priority Queues"). It is split in shards, each one a typed heap of
+// vec.h with its own lock: a push goes to a random shard, and a pop looks
+// at the tops of two random shards and takes the better one. Threads
+// rarely meet on the same lock, so it scales where a single locked heap
+// stops, in exchange for pops being relaxed: an item popped is among the
+// best few of the queue, not always the best. With c * P shards for P
+// threads, it is on average fewer than c * P places below the true top.
+// The shard tops are cached in atomics, so choosing a shard takes no
+// lock. That needs integer priorities: key(item) is a uint64_t, lower
+// keys come out first (use ~x for the highest first), and it must be
+// below CARR_MQUEUE_EMPTY.
+// The file [examples/56-multiqueue.c] provides a complete example.
+
+/*-----------------------------------------------------------------------------+
+ *                                                                             *
+ *  CARR_MQUEUE_DEFINE(Name, T, key) generates:                                *
+ *      void   Name##_init(Name* q, size_t n_shards)                           *
+ *      void   Name##_free(Name* q)                                            *
+ *      void   Name##_push(Name* q, T item)                                    *
+ *      bool   Name##_pop(Name* q, T* res)   false if the queue is empty       *
+ *      size_t Name##_len(Name* q)                                             *
+ *  Only free must not run at the same time as the others.                     *
+ *                                                                             *
+ +-----------------------------------------------------------------------------*/
+
+// Shards per core when Name##_init is given 0.
+#ifndef CARR_MQUEUE_SHARDS_PER_CORE
+#define CARR_MQUEUE_SHARDS_PER_CORE 2
+#endif // CARR_MQUEUE_SHARDS_PER_CORE
+
+// Every shard starts on its own cache line, as the ones of cmap.h.
+#ifndef CARR_MQUEUE_CACHE_LINE
+#define CARR_MQUEUE_CACHE_LINE 64
+#endif // CARR_MQUEUE_CACHE_LINE
+
+// Busy shards skipped before a push or pop stops picking at random and
+// waits for a lock instead.
+#ifndef CARR_MQUEUE_TRIES
+#define CARR_MQUEUE_TRIES 8
+#endif // CARR_MQUEUE_TRIES
+
+// Cached top of an empty shard.
+#define CARR_MQUEUE_EMPTY UINT64_MAX
+
+static inline size_t _carr_mqueue_random(size_t n)
+{
+    static _Thread_local uint64_t state = 0;
+    if (state == 0) {
+        // Every thread has its own state, at its own address.
+        state = (uint64_t)(uintptr_t)&state * 0x9e3779b97f4a7c15ull | 1;
+    }
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return (size_t)(state % n);
+}
+
+static inline size_t _carr_mqueue_default_shards(void)
+{
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return (cores > 0 ? (size_t)cores : 1) * CARR_MQUEUE_SHARDS_PER_CORE;
+}
+
+#define CARR_MQUEUE_DEFINE(Name, T, key)                                       \
+static inline bool Name##_before(T a, T b)                                     \
+{                                                                              \
+    return key(a) < key(b);                                                    \
+}                                                                              \
+                                                                               \
+CARR_HEAP_DEFINE(Name##_shard, T, Name##_before)                               \
+                                                                               \
+typedef struct {                                                               \
+    _Alignas(CARR_MQUEUE_CACHE_LINE) pthread_mutex_t lock;                     \
+    /* Key of the top item, read without the lock to choose a shard. */        \
+    _Atomic uint64_t top;                                                      \
+    struct { T* items; size_t len; size_t cap; } heap;                         \
+} Name##Shard;                                                                 \
+                                                                               \
+typedef struct {                                                               \
+    Name##Shard* shards;                                                       \
+    size_t       n_shards;                                                     \
+} Name;                                                                        \
+                                                                               \
+/* n_shards 0 means CARR_MQUEUE_SHARDS_PER_CORE per core. */                   \
+static inline void Name##_init(Name* q, size_t n_shards)                       \
+{                                                                              \
+    if (n_shards == 0) {                                                       \
+        n_shards = _carr_mqueue_default_shards();                              \
+    }                                                                          \
+    q->n_shards = n_shards;                                                    \
+    q->shards   = (Name##Shard*)aligned_alloc(                                 \
+        CARR_MQUEUE_CACHE_LINE, n_shards * sizeof(Name##Shard)                 \
+    );                                                                         \
+    for (size_t i = 0; i < n_shards; ++i) {                                    \
+        pthread_mutex_init(&q->shards[i].lock, NULL);                          \
+        atomic_init(&q->shards[i].top, CARR_MQUEUE_EMPTY);                     \
+        carr_vec_init(&q->shards[i].heap);                                     \
+    }                                                                          \
+}                                                                              \
+                                                                               \
+static inline void Name##_free(Name* q)                                        \
+{                                                                              \
+    for (size_t i = 0; i < q->n_shards; ++i) {                                 \
+        pthread_mutex_destroy(&q->shards[i].lock);                             \
+        carr_vec_free(&q->shards[i].heap);                                     \
+    }                                                                          \
+    free(q->shards);                                                           \
+    *q = (Name){0};                                                            \
+}                                                                              \
+                                                                               \
+/* Called with the lock of s held. */                                          \
+static inline void Name##_update_top(Name##Shard* s)                           \
+{                                                                              \
+    uint64_t top = s->heap.len > 0                                             \
+        ? key(s->heap.items[0])                                                \
+        : CARR_MQUEUE_EMPTY;                                                   \
+    atomic_store_explicit(&s->top, top, memory_order_relaxed);                 \
+}                                                                              \
+                                                                               \
+static inline void Name##_push(Name* q, T item)                                \
+{                                                                              \
+    assert(key(item) != CARR_MQUEUE_EMPTY);                                    \
+    Name##Shard* s;                                                            \
+    for (unsigned tries = 0;; ++tries) {                                       \
+        s = &q->shards[_carr_mqueue_random(q->n_shards)];                      \
+        if (pthread_mutex_trylock(&s->lock) == 0) {                            \
+            break;                                                             \
+        }                                                                      \
+        if (tries == CARR_MQUEUE_TRIES) {                                      \
+            pthread_mutex_lock(&s->lock);                                      \
+            break;                                                             \
+        }                                                                      \
+    }                                                                          \
+    carr_typed_heap_push(&s->heap, Name##_shard, item);                        \
+    Name##_update_top(s);                                                      \
+    pthread_mutex_unlock(&s->lock);                                            \
+}                                                                              \
+                                                                               \
+/* The shard with the lowest top, or NULL if they all look empty. */           \
+static inline Name##Shard* Name##_best_shard(Name* q)                          \
+{                                                                              \
+    Name##Shard* best = NULL;                                                  \
+    uint64_t     min  = CARR_MQUEUE_EMPTY;                                     \
+    for (size_t i = 0; i < q->n_shards; ++i) {                                 \
+        uint64_t top = atomic_load_explicit(                                   \
+            &q->shards[i].top, memory_order_relaxed                            \
+        );                                                                     \
+        if (top < min) {                                                       \
+            min  = top;                                                        \
+            best = &q->shards[i];                                              \
+        }                                                                      \
+    }                                                                          \
+    return best;                                                               \
+}                                                                              \
+                                                                               \
+static inline bool Name##_pop(Name* q, T* res)                                 \
+{                                                                              \
+    for (unsigned tries = 0;; ++tries) {                                       \
+        Name##Shard* s;                                                        \
+        if (tries < CARR_MQUEUE_TRIES) {                                       \
+            Name##Shard* a  = &q->shards[_carr_mqueue_random(q->n_shards)];    \
+            Name##Shard* b  = &q->shards[_carr_mqueue_random(q->n_shards)];    \
+            uint64_t     ka = atomic_load_explicit(                            \
+                &a->top, memory_order_relaxed                                  \
+            );                                                                 \
+            uint64_t     kb = atomic_load_explicit(                            \
+                &b->top, memory_order_relaxed                                  \
+            );                                                                 \
+            s = kb < ka ? b : a;                                               \
+            if (                                                               \
+                (ka == CARR_MQUEUE_EMPTY && kb == CARR_MQUEUE_EMPTY) ||        \
+                pthread_mutex_trylock(&s->lock) != 0                           \
+            ) {                                                                \
+                continue;                                                      \
+            }                                                                  \
+        } else {                                                               \
+            /* Most shards are empty or busy: look at all of them. */          \
+            s = Name##_best_shard(q);                                          \
+            if (s == NULL) {                                                   \
+                return false;                                                  \
+            }                                                                  \
+            pthread_mutex_lock(&s->lock);                                      \
+        }                                                                      \
+        if (s->heap.len == 0) {                                                \
+            /* Emptied by another thread since its top was read. */            \
+            pthread_mutex_unlock(&s->lock);                                    \
+            continue;                                                          \
+        }                                                                      \
+        carr_typed_heap_pop(&s->heap, Name##_shard, res);                      \
+        Name##_update_top(s);                                                  \
+        pthread_mutex_unlock(&s->lock);                                        \
+        return true;                                                           \
+    }                                                                          \
+}                                                                              \
+                                                                               \
+/* Only exact when no other thread is pushing or popping. */                   \
+static inline size_t Name##_len(Name* q)                                       \
+{                                                                              \
+    size_t len = 0;                                                            \
+    for (size_t i = 0; i < q->n_shards; ++i) {                                 \
+        pthread_mutex_lock(&q->shards[i].lock);                                \
+        len += q->shards[i].heap.len;                                          \
+        pthread_mutex_unlock(&q->shards[i].lock);                              \
+    }                                                                          \
+    return len;                                                                \
+}
+
+#endif // CARR_MQUEUE_H_
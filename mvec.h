@@ -0,0 +1,436 @@
+#ifndef CARR_MVEC_H_
+#define CARR_MVEC_H_
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "vec.h"
+
+// A vec whose items live in a memory mapped file, for arrays of plain
+// fixed size records that are bigger than memory or must outlive the
+// process. Opening an existing file maps it and sets len from its header:
+// the items are used in place, with no parsing or copying.
+// The file is a page with a small header followed by the items, and it is
+// kept a little longer than the items to leave room for appends.
+// All the vec_* macros work on an mvec. When it runs out of room,
+// vec_append, vec_reserve and the others grow the file and the mapping
+// (with ftruncate and mremap) instead of calling CARR_REALLOC, by
+// CARR_VEC_GROWTH_FACTOR as for any vec, and vec_free closes it like
+// carr_mvec_close, which trims the file back to len items.
+// For that, this file redefines the hooks through which the vec_* macros
+// grow and free items, so they first look the items up in a table of the
+// open mvecs. The lookup only happens when a vec grows or is freed, and is
+// skipped while no mvec is open. The CarrMVecFile field of an mvec makes
+// sure every file that uses one includes this file, and so gets the hooks.
+// A vec_* macro that fails to grow an mvec exits, as a failed realloc
+// would crash; carr_mvec_append and carr_mvec_extend evaluate to false
+// instead, and leave the mvec as it was.
+// The items are stored with the layout and byte order of the machine, so
+// they must not contain pointers.
+
+// The user can define this macro to include only the functions
+// with the 'carr_' prefix, as to avoid name collisions.
+// If this macro is not defined, all the versions without prefix
+// will also be included by default.
+#ifndef CARR_MVEC_FORCE_PREFIX
+
+#define mvec_open    carr_mvec_open
+#define mvec_close   carr_mvec_close
+#define mvec_reserve carr_mvec_reserve
+#define mvec_append  carr_mvec_append
+#define mvec_extend  carr_mvec_extend
+#define mvec_sync    carr_mvec_sync
+#define mvec_advise  carr_mvec_advise
+
+#endif // CARR_MVEC_FORCE_PREFIX
+
+/*-----------------------------------------------------------------------------+
+ *                                                                             *
+ *  All the mvec_* macros assume a struct in the form:                         *
+ *  typedef struct {                                                           *
+ *       T*          items                                                     *
+ *       size_t      len                                                       *
+ *       size_t      cap                                                       *
+ *       CarrMVecFile file                                                     *
+ *  } SomeUserStruct;                                                          *
+ *  which is a regular vec struct with an extra field.                         *
+ *                                                                             *
+ +-----------------------------------------------------------------------------*/
+
+// Room left for appends when a file is opened with reserve 0, in bytes.
+// It is kept small, as not every file system has sparse files; appends
+// grow the file as needed.
+#ifndef CARR_MVEC_DEFAULT_RESERVE
+#define CARR_MVEC_DEFAULT_RESERVE ((size_t)1 << 20)
+#endif // CARR_MVEC_DEFAULT_RESERVE
+
+#define CARR_MVEC_MAGIC       "CARRMVEC"
+#define CARR_MVEC_VERSION     1
+// The items start one page in, so they are page aligned.
+#define CARR_MVEC_HEADER_SIZE 4096
+
+typedef struct {
+    char     magic[8];
+    uint64_t version;
+    uint64_t item_size;
+    uint64_t len;
+} CarrMVecHeader;
+
+// The extra field of an mvec: the descriptor of the file, for the user to
+// fstat or lock it. The rest of the state of a mapping (where it starts,
+// its size) is kept in the table of open mvecs, under the address of the
+// items, so that the vec_* macros find it with the items alone.
+typedef struct {
+    int fd;
+} CarrMVecFile;
+
+// Opens or creates the file at path and maps it, with room for at least
+// reserve items (0 means CARR_MVEC_DEFAULT_RESERVE bytes worth of them).
+// Evaluates to false if the file cannot be opened or was written with
+// another item size.
+#define carr_mvec_open(vec, path, reserve)                                     \
+    (((vec)->items = _carr_mvec_open(                                          \
+        (path), sizeof((vec)->items[0]), (reserve),                            \
+        &(vec)->file.fd, &(vec)->len, &(vec)->cap                              \
+    )) != NULL)
+
+// Makes room for n items in total. Evaluates to false on failure, in
+// which case the vec is left as it was.
+#define carr_mvec_reserve(vec, n)                                              \
+    ((vec)->items = _carr_mvec_reserve(                                        \
+        (vec)->items, &(vec)->cap, (n), sizeof((vec)->items[0])                \
+    ), (vec)->cap >= (n))
+
+// Makes room for n more items, growing the file by CARR_VEC_GROWTH_FACTOR
+// as many times as needed at once. Evaluates to false on failure.
+#define _carr_mvec_grow(vec, n)                                                \
+    ((vec)->len + (n) <= (vec)->cap ||                                         \
+        carr_mvec_reserve(                                                     \
+            (vec), _carr_vec_next_cap((vec)->cap, (vec)->len + (n))            \
+        ))
+
+// Appends item, growing the file if needed. Evaluates to false if the file
+// could not grow, in which case nothing is appended.
+#define carr_mvec_append(vec, item)                                            \
+    (_carr_mvec_grow((vec), 1) &&                                              \
+        ((vec)->items[(vec)->len++] = (item), true))
+
+// Appends the n items pointed to by src with a single copy. Evaluates to
+// false if the file could not grow, in which case nothing is appended.
+#define carr_mvec_extend(vec, src, n)                                          \
+    (_carr_mvec_grow((vec), (n)) &&                                            \
+        (memcpy(                                                               \
+            (vec)->items + (vec)->len, (src), (n) * sizeof((vec)->items[0])    \
+        ), (vec)->len += (n), true))
+
+// Stores len in the file and writes the dirty pages back, waiting for the
+// disk if wait is true.
+#define carr_mvec_sync(vec, wait)                                              \
+    _carr_mvec_sync((vec)->items, (vec)->len, (wait))
+
+// Tells the kernel how the items are going to be read, with one of the
+// madvise flags: MADV_SEQUENTIAL, MADV_RANDOM, MADV_WILLNEED, ...
+#define carr_mvec_advise(vec, advice)                                          \
+    madvise(                                                                   \
+        (uint8_t*)(vec)->items - CARR_MVEC_HEADER_SIZE,                        \
+        CARR_MVEC_HEADER_SIZE + (vec)->cap * sizeof((vec)->items[0]),          \
+        (advice)                                                               \
+    )
+
+// Syncs, trims the file to len items and unmaps it.
+#define carr_mvec_close(vec)                                                   \
+do {                                                                           \
+    _carr_mvec_close((vec)->items, (vec)->len);                                \
+    (vec)->items   = NULL;                                                     \
+    (vec)->len     = 0;                                                        \
+    (vec)->cap     = 0;                                                        \
+    (vec)->file.fd = -1;                                                       \
+} while (0)
+
+// The hooks of vec.h, so the vec_* macros grow and close mvecs too.
+#undef _carr_vec_items_realloc
+#define _carr_vec_items_realloc(vec, n)                                        \
+    (_carr_mvec_is_mapped((vec)->items)                                        \
+        ? _carr_mvec_realloc((vec)->items, (n) * sizeof((vec)->items[0]))      \
+        : CARR_REALLOC((vec)->items, (n) * sizeof((vec)->items[0])))
+
+#undef _carr_vec_items_free
+#define _carr_vec_items_free(vec)                                              \
+do {                                                                           \
+    if (_carr_mvec_is_mapped((vec)->items)) {                                  \
+        _carr_mvec_close((vec)->items, (vec)->len);                            \
+    } else {                                                                   \
+        CARR_FREE((vec)->items);                                               \
+    }                                                                          \
+} while (0)
+
+void* _carr_mvec_open(
+    const char* path, size_t item_size, size_t reserve, int* fd,
+    size_t* len, size_t* cap
+);
+bool  _carr_mvec_is_mapped(const void* items);
+void* _carr_mvec_reserve(void* items, size_t* cap, size_t n, size_t size);
+void* _carr_mvec_realloc(void* items, size_t size);
+void  _carr_mvec_sync(void* items, size_t len, bool wait);
+void  _carr_mvec_close(void* items, size_t len);
+
+#ifdef CARR_MVEC_IMPLEMENTATION
+
+// An open mvec, found by the address of its items.
+typedef struct {
+    uint8_t* items;
+    int      fd;
+    size_t   mapped;
+} _CarrMVecMapping;
+
+// The open mvecs. n_open is only written with the lock held, and is read
+// without it to skip the lookup while there are none.
+static pthread_mutex_t   _carr_mvec_lock = PTHREAD_MUTEX_INITIALIZER;
+static _CarrMVecMapping* _carr_mvec_maps;
+static size_t            _carr_mvec_maps_cap;
+static _Atomic size_t    _carr_mvec_n_open;
+
+#define _carr_mvec_base(items) ((uint8_t*)(items) - CARR_MVEC_HEADER_SIZE)
+
+// Returns the index of the mapping of items in _carr_mvec_maps, or
+// SIZE_MAX. Must be called with the lock held.
+size_t _carr_mvec_find(const void* items)
+{
+    size_t n = atomic_load_explicit(&_carr_mvec_n_open, memory_order_relaxed);
+    for (size_t i = 0; i < n; ++i) {
+        if (_carr_mvec_maps[i].items == items) {
+            return i;
+        }
+    }
+    return SIZE_MAX;
+}
+
+bool _carr_mvec_is_mapped(const void* items)
+{
+    if (
+        items == NULL ||
+        atomic_load_explicit(&_carr_mvec_n_open, memory_order_relaxed) == 0
+    ) {
+        return false;
+    }
+    pthread_mutex_lock(&_carr_mvec_lock);
+    bool found = _carr_mvec_find(items) != SIZE_MAX;
+    pthread_mutex_unlock(&_carr_mvec_lock);
+    return found;
+}
+
+// Grows the file of m to size bytes and maps all of it. Returns false on
+// failure, in which case the old mapping is left as it was.
+bool _carr_mvec_map(_CarrMVecMapping* m, size_t size)
+{
+    if (ftruncate(m->fd, size) < 0) {
+        return false;
+    }
+
+    void* base;
+    if (m->items == NULL) {
+        base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, m->fd, 0);
+    } else {
+#ifdef MREMAP_MAYMOVE
+        base = mremap(
+            _carr_mvec_base(m->items), m->mapped, size, MREMAP_MAYMOVE
+        );
+#else
+        // The pages belong to the file, so mapping it again copies nothing.
+        // The old mapping goes only once the new one is there, so a failure
+        // leaves the vec as it was.
+        base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, m->fd, 0);
+        if (base != MAP_FAILED) {
+            munmap(_carr_mvec_base(m->items), m->mapped);
+        }
+#endif
+    }
+    if (base == MAP_FAILED) {
+        return false;
+    }
+    m->items  = (uint8_t*)base + CARR_MVEC_HEADER_SIZE;
+    m->mapped = size;
+    return true;
+}
+
+void* _carr_mvec_open(
+    const char* path, size_t item_size, size_t reserve, int* fd,
+    size_t* len, size_t* cap
+) {
+    _CarrMVecMapping m = { .fd = open(path, O_RDWR | O_CREAT, 0644) };
+    *fd = -1;
+
+    struct stat st;
+    if (m.fd < 0 || fstat(m.fd, &st) < 0) {
+        printf(
+            "%s:%d:ERROR: mvec_open: failed to open file '%s': %s\n",
+            __FILE_NAME__, __LINE__, path, strerror(errno)
+        );
+        if (m.fd >= 0) {
+            close(m.fd);
+        }
+        return NULL;
+    }
+
+    CarrMVecHeader h = {
+        .magic     = CARR_MVEC_MAGIC,
+        .version   = CARR_MVEC_VERSION,
+        .item_size = item_size,
+        .len       = 0,
+    };
+    if (st.st_size > 0) {
+        ssize_t n = pread(m.fd, &h, sizeof(h), 0);
+        if (
+            n != (ssize_t)sizeof(h) ||
+            memcmp(h.magic, CARR_MVEC_MAGIC, sizeof(h.magic)) != 0 ||
+            h.version != CARR_MVEC_VERSION || h.item_size != item_size ||
+            (size_t)st.st_size < CARR_MVEC_HEADER_SIZE + h.len * item_size
+        ) {
+            printf(
+                "%s:%d:ERROR: mvec_open: '%s' is not a vec of %zu byte items\n",
+                __FILE_NAME__, __LINE__, path, item_size
+            );
+            close(m.fd);
+            return NULL;
+        }
+    }
+
+    if (reserve == 0) {
+        reserve = CARR_MVEC_DEFAULT_RESERVE / item_size;
+    }
+    size_t n = h.len + reserve;
+    if (!_carr_mvec_map(&m, CARR_MVEC_HEADER_SIZE + n * item_size)) {
+        printf(
+            "%s:%d:ERROR: mvec_open: failed to map file '%s': %s\n",
+            __FILE_NAME__, __LINE__, path, strerror(errno)
+        );
+        close(m.fd);
+        return NULL;
+    }
+    memcpy(_carr_mvec_base(m.items), &h, sizeof(h));
+
+    pthread_mutex_lock(&_carr_mvec_lock);
+    size_t i = atomic_load_explicit(&_carr_mvec_n_open, memory_order_relaxed);
+    if (i == _carr_mvec_maps_cap) {
+        // Not a vec_* macro, as those would look the table up again.
+        size_t            new_cap = i == 0 ? 8 : 2 * i;
+        _CarrMVecMapping* maps    = realloc(
+            _carr_mvec_maps, new_cap * sizeof(maps[0])
+        );
+        if (maps == NULL) {
+            pthread_mutex_unlock(&_carr_mvec_lock);
+            printf(
+                "%s:%d:ERROR: mvec_open: no memory to open '%s'\n",
+                __FILE_NAME__, __LINE__, path
+            );
+            munmap(_carr_mvec_base(m.items), m.mapped);
+            close(m.fd);
+            return NULL;
+        }
+        _carr_mvec_maps     = maps;
+        _carr_mvec_maps_cap = new_cap;
+    }
+    _carr_mvec_maps[i] = m;
+    atomic_store_explicit(&_carr_mvec_n_open, i + 1, memory_order_relaxed);
+    pthread_mutex_unlock(&_carr_mvec_lock);
+
+    *fd  = m.fd;
+    *len = h.len;
+    *cap = n;
+    return m.items;
+}
+
+// Grows the mvec of items to n items of the given size. Returns the items,
+// which may have moved, and sets cap to n; on failure returns them as they
+// were and leaves cap alone.
+void* _carr_mvec_reserve(void* items, size_t* cap, size_t n, size_t size)
+{
+    if (n <= *cap) {
+        return items;
+    }
+    pthread_mutex_lock(&_carr_mvec_lock);
+    size_t i = _carr_mvec_find(items);
+    if (
+        i != SIZE_MAX &&
+        _carr_mvec_map(&_carr_mvec_maps[i], CARR_MVEC_HEADER_SIZE + n * size)
+    ) {
+        items = _carr_mvec_maps[i].items;
+        *cap  = n;
+    }
+    pthread_mutex_unlock(&_carr_mvec_lock);
+    return items;
+}
+
+// The CARR_REALLOC of mapped items, for the vec_* macros.
+void* _carr_mvec_realloc(void* items, size_t size)
+{
+    size_t item_size = ((CarrMVecHeader*)_carr_mvec_base(items))->item_size;
+    size_t n         = size / item_size;
+    size_t cap       = 0;
+    items = _carr_mvec_reserve(items, &cap, n, item_size);
+    if (cap != n) {
+        printf(
+            "%s:%d:ERROR: Cannot grow mvec to %zu bytes: %s\n",
+            __FILE_NAME__, __LINE__, size, strerror(errno)
+        );
+        exit(2);
+    }
+    return items;
+}
+
+void _carr_mvec_sync(void* items, size_t len, bool wait)
+{
+    CarrMVecHeader* h = (CarrMVecHeader*)_carr_mvec_base(items);
+    h->len = len;
+    msync(
+        h, CARR_MVEC_HEADER_SIZE + len * h->item_size,
+        wait ? MS_SYNC : MS_ASYNC
+    );
+}
+
+void _carr_mvec_close(void* items, size_t len)
+{
+    pthread_mutex_lock(&_carr_mvec_lock);
+    size_t i = _carr_mvec_find(items);
+    if (i == SIZE_MAX) {
+        pthread_mutex_unlock(&_carr_mvec_lock);
+        return;
+    }
+    _CarrMVecMapping m = _carr_mvec_maps[i];
+    size_t           n = atomic_load_explicit(
+        &_carr_mvec_n_open, memory_order_relaxed
+    );
+    _carr_mvec_maps[i] = _carr_mvec_maps[n - 1];
+    atomic_store_explicit(&_carr_mvec_n_open, n - 1, memory_order_relaxed);
+    pthread_mutex_unlock(&_carr_mvec_lock);
+
+    _carr_mvec_sync(m.items, len, true);
+    size_t item_size = ((CarrMVecHeader*)_carr_mvec_base(m.items))->item_size;
+    munmap(_carr_mvec_base(m.items), m.mapped);
+    // Gives back the room reserved for appends.
+    if (ftruncate(m.fd, CARR_MVEC_HEADER_SIZE + len * item_size) < 0) {
+        printf(
+            "%s:%d:ERROR: mvec_close: failed to trim file: %s\n",
+            __FILE_NAME__, __LINE__, strerror(errno)
+        );
+    }
+    close(m.fd);
+}
+
+#endif // CARR_MVEC_IMPLEMENTATION
+
+#endif // CARR_MVEC_H_
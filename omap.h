@@ -0,0 +1,291 @@
+#ifndef CARR_OMAP_H_
+#define CARR_OMAP_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "map.h"
+
+// An insertion-ordered map, with the same layout as the CPython dict:
+// the entries live in a dense array, in the order they were inserted,
+// and a separate hash index of 32 bit slots points into it.
+// Iterating is a linear scan of items[0..len], with no empty slots to
+// skip other than the ones left by deletions, which have a NULL key and
+// are compacted away the next time the index is rebuilt.
+// The index has twice as many slots as the entries array, so it is never
+// more than half full. It uses the same hash as Map (see CARR_MAP_HASH),
+// so map.h needs CARR_MAP_IMPLEMENTATION defined in one file as well.
+// Up to 2^32 - 2 entries are supported.
+
+// The user can define this macro to include only the functions
+// with the 'carr_' prefix, as to avoid name collisions.
+// If this macro is not defined, all the versions without prefix
+// will also be included by default.
+#ifndef CARR_OMAP_FORCE_PREFIX
+
+#define OMap           CarrOMap
+#define OMapEntry      CarrOMapEntry
+#define omap_init      carr_omap_init
+#define omap_free      carr_omap_free
+#define omap_reserve   carr_omap_reserve
+#define omap_get       carr_omap_get
+#define omap_nget      carr_omap_nget
+#define omap_insert    carr_omap_insert
+#define omap_upsert    carr_omap_upsert
+#define omap_nupsert   carr_omap_nupsert
+#define omap_delete    carr_omap_delete
+#define omap_ndelete   carr_omap_ndelete
+#define omap_get_sv    carr_omap_get_sv
+#define omap_upsert_sv carr_omap_upsert_sv
+#define omap_delete_sv carr_omap_delete_sv
+
+#endif // CARR_OMAP_FORCE_PREFIX
+
+// Must be a power of two, as the index is masked with index_cap - 1.
+#ifndef CARR_OMAP_INITIAL_CAP
+#define CARR_OMAP_INITIAL_CAP 16
+#endif // CARR_OMAP_INITIAL_CAP
+_Static_assert(
+    CARR_OMAP_INITIAL_CAP > 0 &&
+    (CARR_OMAP_INITIAL_CAP & (CARR_OMAP_INITIAL_CAP - 1)) == 0,
+    "CARR_OMAP_INITIAL_CAP must be a power of two"
+);
+
+#define CARR_OMAP_EMPTY   UINT32_MAX
+#define CARR_OMAP_DELETED (UINT32_MAX - 1)
+
+// key_len is the length of key, with CARR_MAP_KEY_OWNED set when the
+// map owns the key (see carr_map_key_len).
+typedef struct {
+    const char* key;
+    void*       value;
+    uint64_t    hash;
+    size_t      key_len;
+} CarrOMapEntry;
+
+typedef struct {
+    CarrOMapEntry* items;
+    size_t         len;
+    size_t         cap;
+    size_t         count;
+    uint32_t*      index;
+    size_t         index_cap;
+} CarrOMap;
+
+void carr_omap_init(CarrOMap* m);
+void carr_omap_free(CarrOMap* m);
+// Makes room for n entries, so inserting up to n entries never needs to
+// rebuild the map.
+void carr_omap_reserve(CarrOMap* m, size_t n);
+
+// These behave like their Map counterparts: the lookups return an entry
+// with a NULL key when the key is missing, carr_omap_insert stores the
+// key pointer as is, and carr_omap_nupsert stores a copy of the key when
+// it inserts it. The value pointers are valid until the next insertion.
+// As in Map, the copies are owned by the map, which frees them when their
+// entry is deleted and in carr_omap_free, while the other keys stay the
+// user's.
+void   carr_omap_get(CarrOMap* m, const char* key, CarrOMapEntry* e);
+void   carr_omap_nget(CarrOMap* m, const char* key, size_t n, CarrOMapEntry* e);
+void   carr_omap_insert(CarrOMap* m, const char* key, void* value);
+void** carr_omap_upsert(CarrOMap* m, const char* key);
+void** carr_omap_nupsert(CarrOMap* m, const char* key, size_t n);
+void   carr_omap_delete(CarrOMap* m, const char* key);
+void   carr_omap_ndelete(CarrOMap* m, const char* key, size_t n);
+
+#define carr_omap_get_sv(m, sv, e)                                             \
+    carr_omap_nget((m), (sv).data, (sv).len, (e))
+#define carr_omap_upsert_sv(m, sv)                                             \
+    carr_omap_nupsert((m), (sv).data, (sv).len)
+#define carr_omap_delete_sv(m, sv)                                             \
+    carr_omap_ndelete((m), (sv).data, (sv).len)
+
+#ifdef CARR_OMAP_IMPLEMENTATION
+
+// Compacts the deleted entries away, resizes the entries array to
+// new_cap and rebuilds the index from the stored hashes.
+void _carr_omap_rebuild(CarrOMap* m, size_t new_cap)
+{
+    size_t len = 0;
+    for (size_t i = 0; i < m->len; ++i) {
+        if (m->items[i].key != NULL) {
+            m->items[len++] = m->items[i];
+        }
+    }
+    m->len = len;
+
+    if (new_cap != m->cap) {
+        m->items = (CarrOMapEntry*)CARR_REALLOC(
+            m->items, new_cap * sizeof(m->items[0])
+        );
+        m->cap = new_cap;
+    }
+
+    CARR_FREE(m->index);
+    m->index_cap = new_cap * 2;
+    m->index     = (uint32_t*)CARR_MALLOC(m->index_cap * sizeof(m->index[0]));
+    memset(m->index, 0xFF, m->index_cap * sizeof(m->index[0]));
+
+    size_t mask = m->index_cap - 1;
+    for (size_t i = 0; i < m->len; ++i) {
+        size_t pos = m->items[i].hash & mask;
+        while (m->index[pos] != CARR_OMAP_EMPTY) {
+            pos = (pos + 1) & mask;
+        }
+        m->index[pos] = (uint32_t)i;
+    }
+}
+
+void carr_omap_init(CarrOMap* m)
+{
+    *m = (CarrOMap){0};
+    _carr_omap_rebuild(m, CARR_OMAP_INITIAL_CAP);
+}
+
+void carr_omap_free(CarrOMap* m)
+{
+    for (size_t i = 0; i < m->len; ++i) {
+        CarrOMapEntry* e = &m->items[i];
+        if (e->key != NULL && (e->key_len & CARR_MAP_KEY_OWNED)) {
+            CARR_FREE((void*)e->key);
+        }
+    }
+    CARR_FREE(m->items);
+    CARR_FREE(m->index);
+    *m = (CarrOMap){0};
+}
+
+void carr_omap_reserve(CarrOMap* m, size_t n)
+{
+    size_t new_cap = m->cap > 0 ? m->cap : CARR_OMAP_INITIAL_CAP;
+    while (new_cap < n) {
+        new_cap *= 2;
+    }
+    if (new_cap != m->cap) {
+        _carr_omap_rebuild(m, new_cap);
+    }
+}
+
+// Walks the probe sequence of key in the index. If key is in the map,
+// sets found and returns its index slot. Otherwise returns the index
+// slot where it should go.
+size_t _carr_omap_probe(
+    CarrOMap* m, const char* key, size_t n, uint64_t hash, bool* found
+) {
+    size_t mask     = m->index_cap - 1;
+    size_t pos      = hash & mask;
+    size_t free_pos = m->index_cap;
+    for (;;) {
+        uint32_t ix = m->index[pos];
+        if (ix == CARR_OMAP_EMPTY) {
+            *found = false;
+            return free_pos < m->index_cap ? free_pos : pos;
+        }
+        if (ix == CARR_OMAP_DELETED) {
+            if (free_pos == m->index_cap) {
+                free_pos = pos;
+            }
+        } else if (
+            m->items[ix].hash == hash &&
+            _carr_map_key_eq(m->items[ix].key, m->items[ix].key_len, key, n)
+        ) {
+            *found = true;
+            return pos;
+        }
+        pos = (pos + 1) & mask;
+    }
+}
+
+// Returns the position in items of key, appending a new entry with a
+// NULL value if it is not there yet. copy tells whether a new key must
+// be copied or stored as is.
+size_t _carr_omap_find_or_append(
+    CarrOMap* m, const char* key, size_t n, bool copy
+) {
+    if (m->len == m->cap) {
+        // Lots of deleted entries: compacting them is enough.
+        _carr_omap_rebuild(m, m->count < m->cap / 2 ? m->cap : m->cap * 2);
+    }
+
+    bool found;
+    uint64_t hash = CARR_MAP_HASH(key, n);
+    size_t   pos  = _carr_omap_probe(m, key, n, hash, &found);
+    if (found) {
+        return m->index[pos];
+    }
+
+    size_t key_len = n;
+    if (copy) {
+        char* k = (char*)CARR_MALLOC((n + 1) * sizeof(char));
+        memcpy(k, key, n);
+        k[n] = '\0';
+        key      = k;
+        key_len |= CARR_MAP_KEY_OWNED;
+    }
+    m->items[m->len] = (CarrOMapEntry){ key, NULL, hash, key_len };
+    m->index[pos]    = (uint32_t)m->len;
+    m->count++;
+    return m->len++;
+}
+
+void carr_omap_nget(CarrOMap* m, const char* key, size_t n, CarrOMapEntry* e)
+{
+    bool found;
+    size_t pos = _carr_omap_probe(m, key, n, CARR_MAP_HASH(key, n), &found);
+    if (!found) {
+        *e = (CarrOMapEntry){0};
+        return;
+    }
+    *e = m->items[m->index[pos]];
+}
+
+void carr_omap_get(CarrOMap* m, const char* key, CarrOMapEntry* e)
+{
+    carr_omap_nget(m, key, strlen(key), e);
+}
+
+void carr_omap_insert(CarrOMap* m, const char* key, void* value)
+{
+    size_t ix = _carr_omap_find_or_append(m, key, strlen(key), false);
+    m->items[ix].value = value;
+}
+
+void** carr_omap_upsert(CarrOMap* m, const char* key)
+{
+    size_t ix = _carr_omap_find_or_append(m, key, strlen(key), false);
+    return &m->items[ix].value;
+}
+
+void** carr_omap_nupsert(CarrOMap* m, const char* key, size_t n)
+{
+    size_t ix = _carr_omap_find_or_append(m, key, n, true);
+    return &m->items[ix].value;
+}
+
+void carr_omap_ndelete(CarrOMap* m, const char* key, size_t n)
+{
+    bool found;
+    size_t pos = _carr_omap_probe(m, key, n, CARR_MAP_HASH(key, n), &found);
+    if (!found) {
+        return;
+    }
+    CarrOMapEntry* e = &m->items[m->index[pos]];
+    if (e->key_len & CARR_MAP_KEY_OWNED) {
+        CARR_FREE((void*)e->key);
+    }
+    *e = (CarrOMapEntry){0};
+    m->index[pos] = CARR_OMAP_DELETED;
+    m->count--;
+}
+
+void carr_omap_delete(CarrOMap* m, const char* key)
+{
+    carr_omap_ndelete(m, key, strlen(key));
+}
+
+#endif // CARR_OMAP_IMPLEMENTATION
+
+#endif // CARR_OMAP_H_
@@ -0,0 +1,580 @@
+#ifndef CARR_POOL_H_
+#define CARR_POOL_H_
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "vec.h"
+
+// A work-stealing thread pool. Every worker owns a Chase-Lev deque: it
+// pushes and pops tasks at the bottom of its own deque without locks, and
+// when it runs out of work it steals from the top of the deque of another
+// worker, so a thread that got the expensive chunks of a job is helped by
+// the ones that finished early.
+// Tasks are spawned into a CarrPoolGroup and carr_pool_wait waits for all
+// the tasks of a group, running tasks itself in the meantime, so tasks can
+// spawn and wait for other tasks (like the halves of a parallel sort).
+// On top of that, carr_parallel_for and carr_parallel_reduce split any vec
+// (any struct with items and len, like the vec_* and heap_* ones) in
+// chunks, and CARR_POOL_SORT_DEFINE adds a parallel version of the typed
+// sorts of vec.h.
+// Besides the workers, only one other thread at a time (usually the one
+// that created the pool) may spawn tasks into the pool or wait on it.
+// The file [examples/19-parallel_vec.c] provides a complete example.
+
+// The user can define this macro to include only the functions
+// with the 'carr_' prefix, as to avoid name collisions.
+// If this macro is not defined, all the versions without prefix
+// will also be included by default.
+#ifndef CARR_POOL_FORCE_PREFIX
+
+#define Pool                 CarrPool
+#define PoolGroup            CarrPoolGroup
+#define PoolTaskFunction     CarrPoolTaskFunction
+#define PoolRangeFunction    CarrPoolRangeFunction
+#define PoolCombineFunction  CarrPoolCombineFunction
+#define pool_init            carr_pool_init
+#define pool_free            carr_pool_free
+#define pool_spawn           carr_pool_spawn
+#define pool_wait            carr_pool_wait
+#define pool_for_range       carr_pool_for_range
+#define pool_reduce_range    carr_pool_reduce_range
+#define parallel_for         carr_parallel_for
+#define parallel_reduce      carr_parallel_reduce
+#define vec_parallel_sort    carr_vec_parallel_sort
+
+#endif // CARR_POOL_FORCE_PREFIX
+
+#define CARR_POOL_DEQUE_INITIAL_CAP 256
+
+// Slices up to this many items are sorted by a single task.
+#ifndef CARR_POOL_SORT_GRAIN
+#define CARR_POOL_SORT_GRAIN 16384
+#endif // CARR_POOL_SORT_GRAIN
+
+typedef void (*CarrPoolTaskFunction)(void* arg);
+
+// Processes items[start, end) of an array. items is the items pointer of
+// the vec, and ctx is passed along untouched.
+typedef void (*CarrPoolRangeFunction)(
+    void* items, size_t start, size_t end, void* acc, void* ctx
+);
+// Folds the partial result src into dst.
+typedef void (*CarrPoolCombineFunction)(void* dst, const void* src, void* ctx);
+
+typedef struct {
+    atomic_size_t pending;
+} CarrPoolGroup;
+
+typedef struct {
+    CarrPoolTaskFunction fn;
+    void*                arg;
+    CarrPoolGroup*       group;
+} CarrPoolTask;
+
+typedef struct CarrPoolArray {
+    int64_t                cap;
+    struct CarrPoolArray*  prev;
+    _Atomic(CarrPoolTask*) tasks[];
+} CarrPoolArray;
+
+typedef struct {
+    _Alignas(64) atomic_int_fast64_t top;
+    _Alignas(64) atomic_int_fast64_t bottom;
+    _Atomic(CarrPoolArray*)          array;
+} CarrPoolDeque;
+
+typedef struct CarrPool {
+    pthread_t*      threads;
+    size_t          n_workers;
+    // One deque per worker, plus a last one for the outside thread.
+    CarrPoolDeque*  deques;
+    atomic_bool     stop;
+    // Hands every worker the index of its deque.
+    atomic_size_t   next_index;
+    // Tasks sitting in the deques, and workers sleeping for lack of them.
+    atomic_size_t   queued;
+    atomic_size_t   sleepers;
+    pthread_mutex_t lock;
+    pthread_cond_t  wake;
+} CarrPool;
+
+// Starts n_workers threads, 0 means one less than the number of cores
+// (the thread that waits on the pool works as well).
+void carr_pool_init(CarrPool* p, size_t n_workers);
+// Stops the workers. No task may be pending.
+void carr_pool_free(CarrPool* p);
+
+void carr_pool_spawn(
+    CarrPool* p, CarrPoolGroup* g, CarrPoolTaskFunction fn, void* arg
+);
+void carr_pool_wait(CarrPool* p, CarrPoolGroup* g);
+
+// Calls fn on chunks of at most chunk items covering [0, len), in
+// parallel, and returns when all of them are done. acc is NULL.
+void carr_pool_for_range(
+    CarrPool* p, void* items, size_t len, size_t chunk,
+    CarrPoolRangeFunction fn, void* ctx
+);
+
+// Like carr_pool_for_range, but every chunk folds its items into its own
+// accumulator of acc_size bytes, which starts as a copy of identity.
+// Those are then combined in order into result, so combine only needs to
+// be associative.
+void carr_pool_reduce_range(
+    CarrPool* p, void* items, size_t len, size_t chunk,
+    size_t acc_size, const void* identity,
+    CarrPoolRangeFunction fn, CarrPoolCombineFunction combine,
+    void* result, void* ctx
+);
+
+#define carr_parallel_for(pool, vec, chunk, fn, ctx)                           \
+    carr_pool_for_range(                                                       \
+        (pool), (vec)->items, (vec)->len, (chunk), (fn), (ctx)                 \
+    )
+
+// res must point to the accumulator type, which also gives its size.
+#define carr_parallel_reduce(pool, vec, chunk, identity, fn, combine, res, ctx)\
+    carr_pool_reduce_range(                                                    \
+        (pool), (vec)->items, (vec)->len, (chunk), sizeof(*(res)),             \
+        (identity), (fn), (combine), (res), (ctx)                              \
+    )
+
+// CARR_POOL_SORT_DEFINE(Name, T) generates
+//     void Name##_parallel_sort(CarrPool* p, T* items, size_t len)
+// on top of the functions of CARR_VEC_SORT_DEFINE(Name, T, less), which
+// must come first with the same Name and T. Slices are partitioned like in
+// Name##_sort, and the two sides are sorted by different tasks until they
+// get smaller than CARR_POOL_SORT_GRAIN.
+#define carr_vec_parallel_sort(pool, vec, Name)                                \
+    Name##_parallel_sort((pool), (vec)->items, (vec)->len)
+
+#define CARR_POOL_SORT_DEFINE(Name, T)                                         \
+typedef struct {                                                               \
+    CarrPool*      pool;                                                       \
+    CarrPoolGroup* group;                                                      \
+    T*             items;                                                      \
+    size_t         len;                                                        \
+    size_t         depth;                                                      \
+} Name##ParallelSortJob;                                                       \
+                                                                               \
+static inline void Name##_parallel_sort_task(void* arg)                        \
+{                                                                              \
+    Name##ParallelSortJob job = *(Name##ParallelSortJob*)arg;                  \
+    free(arg);                                                                 \
+    while (job.len > CARR_POOL_SORT_GRAIN && job.depth > 0) {                  \
+        job.depth--;                                                           \
+        size_t left, right;                                                    \
+        Name##_partition(job.items, job.len, &left, &right);                   \
+                                                                               \
+        Name##ParallelSortJob* side = (Name##ParallelSortJob*)malloc(          \
+            sizeof(Name##ParallelSortJob)                                      \
+        );                                                                     \
+        *side = job;                                                           \
+        side->items = job.items + right;                                       \
+        side->len   = job.len - right;                                         \
+        carr_pool_spawn(job.pool, job.group, Name##_parallel_sort_task, side); \
+        job.len = left;                                                        \
+    }                                                                          \
+    Name##_sort(job.items, job.len);                                           \
+}                                                                              \
+                                                                               \
+static inline void Name##_parallel_sort(CarrPool* p, T* items, size_t len)     \
+{                                                                              \
+    CarrPoolGroup group = {0};                                                 \
+    Name##ParallelSortJob* job = (Name##ParallelSortJob*)malloc(               \
+        sizeof(Name##ParallelSortJob)                                          \
+    );                                                                         \
+    *job = (Name##ParallelSortJob){ p, &group, items, len, 0 };                \
+    for (size_t m = len; m > 1; m >>= 1) {                                     \
+        job->depth += 2;                                                       \
+    }                                                                          \
+    carr_pool_spawn(p, &group, Name##_parallel_sort_task, job);                \
+    carr_pool_wait(p, &group);                                                 \
+}
+
+#ifdef CARR_POOL_IMPLEMENTATION
+
+// The pool and deque of the current thread, if it is a worker.
+_Thread_local CarrPool* _carr_pool_self_pool  = NULL;
+_Thread_local size_t    _carr_pool_self_index = 0;
+_Thread_local uint64_t  _carr_pool_rng        = 0;
+
+size_t _carr_pool_self(CarrPool* p)
+{
+    return _carr_pool_self_pool == p ? _carr_pool_self_index : p->n_workers;
+}
+
+/*-----------------------------------------------------------------------------+
+ *                                                                             *
+ *  Chase-Lev deque, with the C11 memory orderings of Le, Pop, Cohen and       *
+ *  Zappa Nardelli, "Correct and Efficient Work-Stealing for Weak Memory       *
+ *  Models". Only the owner calls push and take, anyone can call steal.        *
+ *  Arrays outgrown by push are kept until the deque is freed, since a         *
+ *  thief may still be reading them.                                           *
+ *                                                                             *
+ +-----------------------------------------------------------------------------*/
+
+CarrPoolArray* _carr_pool_array_new(int64_t cap, CarrPoolArray* prev)
+{
+    CarrPoolArray* a = (CarrPoolArray*)malloc(
+        sizeof(CarrPoolArray) + cap * sizeof(a->tasks[0])
+    );
+    a->cap  = cap;
+    a->prev = prev;
+    return a;
+}
+
+void _carr_pool_deque_init(CarrPoolDeque* d)
+{
+    atomic_init(&d->top, 0);
+    atomic_init(&d->bottom, 0);
+    atomic_init(
+        &d->array, _carr_pool_array_new(CARR_POOL_DEQUE_INITIAL_CAP, NULL)
+    );
+}
+
+void _carr_pool_deque_free(CarrPoolDeque* d)
+{
+    CarrPoolArray* a = atomic_load_explicit(&d->array, memory_order_relaxed);
+    while (a != NULL) {
+        CarrPoolArray* prev = a->prev;
+        free(a);
+        a = prev;
+    }
+}
+
+void _carr_pool_deque_push(CarrPoolDeque* d, CarrPoolTask* t)
+{
+    int64_t b = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+    int64_t top = atomic_load_explicit(&d->top, memory_order_acquire);
+    CarrPoolArray* a = atomic_load_explicit(&d->array, memory_order_relaxed);
+
+    if (b - top > a->cap - 1) {
+        CarrPoolArray* bigger = _carr_pool_array_new(a->cap * 2, a);
+        for (int64_t i = top; i < b; ++i) {
+            CarrPoolTask* x = atomic_load_explicit(
+                &a->tasks[i & (a->cap - 1)], memory_order_relaxed
+            );
+            atomic_store_explicit(
+                &bigger->tasks[i & (bigger->cap - 1)], x, memory_order_relaxed
+            );
+        }
+        atomic_store_explicit(&d->array, bigger, memory_order_release);
+        a = bigger;
+    }
+    atomic_store_explicit(&a->tasks[b & (a->cap - 1)], t, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+}
+
+CarrPoolTask* _carr_pool_deque_take(CarrPoolDeque* d)
+{
+    int64_t b = atomic_load_explicit(&d->bottom, memory_order_relaxed) - 1;
+    CarrPoolArray* a = atomic_load_explicit(&d->array, memory_order_relaxed);
+    atomic_store_explicit(&d->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t t = atomic_load_explicit(&d->top, memory_order_relaxed);
+
+    CarrPoolTask* x = NULL;
+    if (t <= b) {
+        x = atomic_load_explicit(
+            &a->tasks[b & (a->cap - 1)], memory_order_relaxed
+        );
+        if (t == b) {
+            // The last task: race the thieves for it.
+            if (!atomic_compare_exchange_strong_explicit(
+                &d->top, &t, t + 1, memory_order_seq_cst, memory_order_relaxed
+            )) {
+                x = NULL;
+            }
+            atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+        }
+    } else {
+        atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+    }
+    return x;
+}
+
+CarrPoolTask* _carr_pool_deque_steal(CarrPoolDeque* d)
+{
+    int64_t t = atomic_load_explicit(&d->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t b = atomic_load_explicit(&d->bottom, memory_order_acquire);
+    if (t >= b) {
+        return NULL;
+    }
+
+    CarrPoolArray* a = atomic_load_explicit(&d->array, memory_order_acquire);
+    CarrPoolTask*  x = atomic_load_explicit(
+        &a->tasks[t & (a->cap - 1)], memory_order_relaxed
+    );
+    if (!atomic_compare_exchange_strong_explicit(
+        &d->top, &t, t + 1, memory_order_seq_cst, memory_order_relaxed
+    )) {
+        return NULL;
+    }
+    return x;
+}
+
+/*-----------------------------------------------------------------------------+
+ *                                                                             *
+ *                           POOL                                              *
+ *                                                                             *
+ +-----------------------------------------------------------------------------*/
+
+// Takes a task from the deque of self, or steals one from the others,
+// starting from a random victim.
+CarrPoolTask* _carr_pool_find(CarrPool* p, size_t self)
+{
+    CarrPoolTask* t = _carr_pool_deque_take(&p->deques[self]);
+    if (t == NULL) {
+        size_t n = p->n_workers + 1;
+        _carr_pool_rng ^= _carr_pool_rng << 13;
+        _carr_pool_rng ^= _carr_pool_rng >> 7;
+        _carr_pool_rng ^= _carr_pool_rng << 17;
+        size_t start = _carr_pool_rng % n;
+        for (size_t i = 0; i < n && t == NULL; ++i) {
+            size_t victim = (start + i) % n;
+            if (victim != self) {
+                t = _carr_pool_deque_steal(&p->deques[victim]);
+            }
+        }
+    }
+    if (t != NULL) {
+        atomic_fetch_sub(&p->queued, 1);
+    }
+    return t;
+}
+
+void _carr_pool_run(CarrPoolTask* t)
+{
+    t->fn(t->arg);
+    atomic_fetch_sub_explicit(&t->group->pending, 1, memory_order_release);
+    free(t);
+}
+
+void* _carr_pool_worker(void* arg)
+{
+    CarrPool* p = (CarrPool*)arg;
+    _carr_pool_self_pool  = p;
+    _carr_pool_self_index = atomic_fetch_add(&p->next_index, 1);
+    _carr_pool_rng = 0x9e3779b97f4a7c15ull * (_carr_pool_self_index + 1);
+
+    unsigned idle = 0;
+    while (!atomic_load(&p->stop)) {
+        CarrPoolTask* t = _carr_pool_find(p, _carr_pool_self_index);
+        if (t != NULL) {
+            _carr_pool_run(t);
+            idle = 0;
+            continue;
+        }
+        if (++idle < 64) {
+            sched_yield();
+            continue;
+        }
+
+        // Going to sleep: announce it before checking for work, so a
+        // spawn either sees the sleeper or is seen by the check.
+        pthread_mutex_lock(&p->lock);
+        atomic_fetch_add(&p->sleepers, 1);
+        while (atomic_load(&p->queued) == 0 && !atomic_load(&p->stop)) {
+            pthread_cond_wait(&p->wake, &p->lock);
+        }
+        atomic_fetch_sub(&p->sleepers, 1);
+        pthread_mutex_unlock(&p->lock);
+        idle = 0;
+    }
+    return NULL;
+}
+
+void carr_pool_init(CarrPool* p, size_t n_workers)
+{
+    if (n_workers == 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        n_workers = cores > 1 ? (size_t)cores - 1 : 1;
+    }
+    *p = (CarrPool){0};
+    p->n_workers = n_workers;
+    p->deques    = (CarrPoolDeque*)aligned_alloc(
+        64, (n_workers + 1) * sizeof(CarrPoolDeque)
+    );
+    for (size_t i = 0; i <= n_workers; ++i) {
+        _carr_pool_deque_init(&p->deques[i]);
+    }
+    atomic_init(&p->stop, false);
+    atomic_init(&p->next_index, 0);
+    atomic_init(&p->queued, 0);
+    atomic_init(&p->sleepers, 0);
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->wake, NULL);
+
+    p->threads = (pthread_t*)calloc(n_workers, sizeof(pthread_t));
+    for (size_t i = 0; i < n_workers; ++i) {
+        pthread_create(&p->threads[i], NULL, _carr_pool_worker, p);
+    }
+}
+
+void carr_pool_free(CarrPool* p)
+{
+    pthread_mutex_lock(&p->lock);
+    atomic_store(&p->stop, true);
+    pthread_cond_broadcast(&p->wake);
+    pthread_mutex_unlock(&p->lock);
+
+    for (size_t i = 0; i < p->n_workers; ++i) {
+        pthread_join(p->threads[i], NULL);
+    }
+    for (size_t i = 0; i <= p->n_workers; ++i) {
+        _carr_pool_deque_free(&p->deques[i]);
+    }
+    pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->wake);
+    free(p->threads);
+    free(p->deques);
+    *p = (CarrPool){0};
+}
+
+void carr_pool_spawn(
+    CarrPool* p, CarrPoolGroup* g, CarrPoolTaskFunction fn, void* arg
+) {
+    CarrPoolTask* t = (CarrPoolTask*)malloc(sizeof(CarrPoolTask));
+    *t = (CarrPoolTask){ fn, arg, g };
+    atomic_fetch_add_explicit(&g->pending, 1, memory_order_relaxed);
+
+    _carr_pool_deque_push(&p->deques[_carr_pool_self(p)], t);
+    atomic_fetch_add(&p->queued, 1);
+    if (atomic_load(&p->sleepers) > 0) {
+        pthread_mutex_lock(&p->lock);
+        pthread_cond_signal(&p->wake);
+        pthread_mutex_unlock(&p->lock);
+    }
+}
+
+void carr_pool_wait(CarrPool* p, CarrPoolGroup* g)
+{
+    size_t self = _carr_pool_self(p);
+    if (_carr_pool_rng == 0) {
+        _carr_pool_rng = 0x9e3779b97f4a7c15ull;
+    }
+    while (atomic_load_explicit(&g->pending, memory_order_acquire) > 0) {
+        CarrPoolTask* t = _carr_pool_find(p, self);
+        if (t != NULL) {
+            _carr_pool_run(t);
+        } else {
+            sched_yield();
+        }
+    }
+}
+
+typedef struct {
+    CarrPool*             pool;
+    CarrPoolGroup*        group;
+    void*                 items;
+    size_t                start;
+    size_t                end;
+    size_t                chunk;
+    CarrPoolRangeFunction fn;
+    void*                 ctx;
+    // Accumulators of the chunks when reducing, NULL otherwise.
+    uint8_t*              accs;
+    size_t                acc_size;
+} _CarrPoolRangeJob;
+
+// Splits the range in halves, handing the right ones to other tasks,
+// until it is a single chunk. Splitting in halves (instead of spawning
+// every chunk from one place) lets the thieves take big pieces of work.
+void _carr_pool_range_task(void* arg)
+{
+    _CarrPoolRangeJob job = *(_CarrPoolRangeJob*)arg;
+    free(arg);
+
+    while (job.end - job.start > job.chunk) {
+        size_t n_chunks = (job.end - job.start + job.chunk - 1) / job.chunk;
+        size_t mid      = job.start + (n_chunks / 2) * job.chunk;
+
+        _CarrPoolRangeJob* right = (_CarrPoolRangeJob*)malloc(sizeof(*right));
+        *right = job;
+        right->start = mid;
+        carr_pool_spawn(job.pool, job.group, _carr_pool_range_task, right);
+        job.end = mid;
+    }
+
+    void* acc = NULL;
+    if (job.accs != NULL) {
+        acc = job.accs + (job.start / job.chunk) * job.acc_size;
+    }
+    job.fn(job.items, job.start, job.end, acc, job.ctx);
+}
+
+void _carr_pool_range(CarrPool* p, _CarrPoolRangeJob* job)
+{
+    CarrPoolGroup group = {0};
+    job->pool  = p;
+    job->group = &group;
+    if (job->chunk == 0) {
+        job->chunk = 1;
+    }
+    if (job->end == 0) {
+        free(job);
+        return;
+    }
+    carr_pool_spawn(p, &group, _carr_pool_range_task, job);
+    carr_pool_wait(p, &group);
+}
+
+void carr_pool_for_range(
+    CarrPool* p, void* items, size_t len, size_t chunk,
+    CarrPoolRangeFunction fn, void* ctx
+) {
+    _CarrPoolRangeJob* job = (_CarrPoolRangeJob*)calloc(1, sizeof(*job));
+    job->items = items;
+    job->end   = len;
+    job->chunk = chunk;
+    job->fn    = fn;
+    job->ctx   = ctx;
+    _carr_pool_range(p, job);
+}
+
+void carr_pool_reduce_range(
+    CarrPool* p, void* items, size_t len, size_t chunk,
+    size_t acc_size, const void* identity,
+    CarrPoolRangeFunction fn, CarrPoolCombineFunction combine,
+    void* result, void* ctx
+) {
+    if (chunk == 0) {
+        chunk = 1;
+    }
+    size_t   n_chunks = (len + chunk - 1) / chunk;
+    uint8_t* accs     = (uint8_t*)malloc(n_chunks * acc_size + 1);
+    for (size_t i = 0; i < n_chunks; ++i) {
+        memcpy(accs + i * acc_size, identity, acc_size);
+    }
+
+    _CarrPoolRangeJob* job = (_CarrPoolRangeJob*)calloc(1, sizeof(*job));
+    job->items    = items;
+    job->end      = len;
+    job->chunk    = chunk;
+    job->fn       = fn;
+    job->ctx      = ctx;
+    job->accs     = accs;
+    job->acc_size = acc_size;
+    _carr_pool_range(p, job);
+
+    memcpy(result, identity, acc_size);
+    for (size_t i = 0; i < n_chunks; ++i) {
+        combine(result, accs + i * acc_size, ctx);
+    }
+    free(accs);
+}
+
+#endif // CARR_POOL_IMPLEMENTATION
+
+#endif // CARR_POOL_H_
@@ -48,6 +48,14 @@
 
 #endif  // CARR_SV_FORCE_PREFIX
 
+// The string builders allocate through these. Define all three before
+// including this file to use another allocator, such as arena.h.
+#ifndef CARR_MALLOC
+#define CARR_MALLOC(n)     malloc(n)
+#define CARR_REALLOC(p, n) realloc((p), (n))
+#define CARR_FREE(p)       free(p)
+#endif // CARR_MALLOC
+
 #ifndef CARR_SV_TEMP_STR_SIZE
 #define CARR_SV_TEMP_STR_SIZE 100
 #endif  //CARR_SV_TEMP_STR_SIZE
@@ -139,7 +147,7 @@ CarrStringBuilder carr_sb_from_file(const char* file_path)
 
 void carr_sb_realloc(CarrStringBuilder* sb, size_t new_size)
 {
-    sb->data = (char*)realloc(sb->data, new_size);
+    sb->data = (char*)CARR_REALLOC(sb->data, new_size);
 }
 
 size_t carr_sb_grow_cap(CarrStringBuilder sb)
@@ -162,7 +170,7 @@ void carr_sb_grow(CarrStringBuilder* sb)
 
 void carr_sb_free(CarrStringBuilder* sb)
 {
-    free(sb->data);
+    CARR_FREE(sb->data);
     sb->len = 0;
     sb->cap = 0;
 }
@@ -222,7 +230,7 @@ CarrStringView carr_sv_from_cstr(const char* in)
 
 char *carr_sv_to_cstr(CarrStringView in)
 {
-    char *out = (char*)malloc((in.len + 1) * sizeof(char));
+    char *out = (char*)CARR_MALLOC((in.len + 1) * sizeof(char));
     sprintf(out, "%.*s", (int)in.len, in.data);
     return out;
 }
@@ -2,6 +2,7 @@
 #define CARR_VEC_H_
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stddef.h>
 #include <string.h>
@@ -26,6 +27,35 @@
 #define vec_swap      carr_vec_swap
 #define vec_free      carr_vec_free
 #define vec_clone     carr_vec_clone
+#define vec_reserve   carr_vec_reserve
+#define vec_extend    carr_vec_extend
+#define vec_resize    carr_vec_resize
+
+#define vec_swap_remove  carr_vec_swap_remove
+#define vec_delete_range carr_vec_delete_range
+#define vec_retain       carr_vec_retain
+
+#define small_vec_init      carr_small_vec_init
+#define small_vec_is_inline carr_small_vec_is_inline
+#define small_vec_realloc   carr_small_vec_realloc
+#define small_vec_reserve   carr_small_vec_reserve
+#define small_vec_append    carr_small_vec_append
+#define small_vec_extend    carr_small_vec_extend
+#define small_vec_free      carr_small_vec_free
+
+#define segvec_init          carr_segvec_init
+#define segvec_free          carr_segvec_free
+#define segvec_at            carr_segvec_at
+#define segvec_ptr           carr_segvec_ptr
+#define segvec_append        carr_segvec_append
+#define segvec_pop           carr_segvec_pop
+#define segvec_foreach_block carr_segvec_foreach_block
+
+#define vec_sort         carr_vec_sort
+#define vec_stable_sort  carr_vec_stable_sort
+#define vec_radix_sort   carr_vec_radix_sort
+#define vec_lower_bound  carr_vec_lower_bound
+#define vec_upper_bound  carr_vec_upper_bound
 
 #define heapfy        carr_heapfy
 #define heap_new      carr_heap_new
@@ -37,10 +67,29 @@
 #define heap_left     carr_heap_left
 #define heap_right    carr_heap_right
 
+#define heap_push_many carr_heap_push_many
+#define heap_pop_k     carr_heap_pop_k
+
+#define typed_heapfy         carr_typed_heapfy
+#define typed_heap_push      carr_typed_heap_push
+#define typed_heap_pop       carr_typed_heap_pop
+#define typed_heap_increase  carr_typed_heap_increase
+#define typed_heap_push_many carr_typed_heap_push_many
+#define typed_heap_pop_k     carr_typed_heap_pop_k
+
 #define HeapCompareFunction CarrHeapCompareFunction
 
 #endif // CARR_VEC_FORCE_PREFIX
 
+// Every allocation of the vec_* and heap_* macros goes through these, so
+// the user can plug in another allocator (like the arena of arena.h) by
+// defining all three before including this file.
+#ifndef CARR_MALLOC
+#define CARR_MALLOC(n)     malloc(n)
+#define CARR_REALLOC(p, n) realloc((p), (n))
+#define CARR_FREE(p)       free(p)
+#endif // CARR_MALLOC
+
 /*-----------------------------------------------------------------------------+
  *                                                                             *
  *                           VEC STUFF                                         *
@@ -64,21 +113,96 @@
 #endif  // CARR_VEC_INITIAL_CAP
 
 
-#define carr_vec_realloc(vec, new_size) \
+// Growth factor applied to the capacity every time a vec runs out of room.
+// 2 needs the fewest reallocations, while something like 1.5 lets the
+// allocator reuse the blocks freed by the earlier growths of the same vec.
+#ifndef CARR_VEC_GROWTH_FACTOR
+#define CARR_VEC_GROWTH_FACTOR 2
+#endif  // CARR_VEC_GROWTH_FACTOR
+
+// Returns the capacity a vec of capacity cap must grow to, so it can hold
+// at least needed items.
+static inline size_t _carr_vec_next_cap(size_t cap, size_t needed)
+{
+    if (cap == 0) {
+        cap = CARR_VEC_INITIAL_CAP;
+    }
+    while (cap < needed) {
+        size_t next = (size_t)(cap * CARR_VEC_GROWTH_FACTOR);
+        cap = next > cap ? next : cap + 1;
+    }
+    return cap;
+}
+
+// The vec_* macros grow and free the items of a vec only through these.
+// mvec.h redefines them, so they also work on its vecs, whose items are
+// a file mapping instead of a CARR_MALLOC block.
+#define _carr_vec_items_realloc(vec, n)                                        \
+    CARR_REALLOC((vec)->items, (n) * sizeof((vec)->items[0]))
+
+#define _carr_vec_items_free(vec)                                              \
+    CARR_FREE((vec)->items)
+
+// While a small vec is inline its items are inside the vec struct itself,
+// not a CARR_MALLOC block, so it must grow and be freed through the
+// small_vec_* macros. Debug builds catch the plain vec_* ones doing it;
+// with NDEBUG this goes away, like the bounds checks of vec_at.
+#define _carr_vec_assert_not_inline(vec)                                       \
+    assert(                                                                    \
+        (uintptr_t)(vec)->items - (uintptr_t)(vec) >= sizeof(*(vec)) &&        \
+        "grow and free small vecs with the small_vec_* macros"                 \
+    )
+
+// Makes room for new_cap items in total. Never shrinks the vec.
+#define carr_vec_realloc(vec, new_cap)                                         \
 do {                                                                           \
-    if ((vec)->cap < new_size) {                                               \
-        (vec)->items = realloc((vec)->items, (new_size));                      \
+    size_t _carr_new_cap = (new_cap);                                          \
+    if ((vec)->cap < _carr_new_cap) {                                          \
+        _carr_vec_assert_not_inline((vec));                                    \
+        (vec)->items = _carr_vec_items_realloc((vec), _carr_new_cap);          \
+        (vec)->cap   = _carr_new_cap;                                          \
     }                                                                          \
 } while (0)
 
 #define carr_vec_grow_cap(vec)                                                 \
-    (vec)->cap > 0 ? (vec)->cap * 2 : CARR_VEC_INITIAL_CAP
+    _carr_vec_next_cap((vec)->cap, (vec)->cap + 1)
 
 #define carr_vec_grow(vec)                                                     \
+    carr_vec_realloc((vec), carr_vec_grow_cap((vec)))
+
+// Makes room for n more items, growing by CARR_VEC_GROWTH_FACTOR as many
+// times as needed with a single realloc.
+#define carr_vec_reserve(vec, n)                                               \
+do {                                                                           \
+    size_t _carr_needed = (vec)->len + (n);                                    \
+    if (_carr_needed > (vec)->cap) {                                           \
+        carr_vec_realloc((vec), _carr_vec_next_cap((vec)->cap, _carr_needed)); \
+    }                                                                          \
+} while (0)
+
+// Appends the n items pointed to by src with a single copy.
+#define carr_vec_extend(vec, src, n)                                           \
+do {                                                                           \
+    size_t _carr_n = (n);                                                      \
+    carr_vec_reserve((vec), _carr_n);                                          \
+    memcpy(                                                                    \
+        (vec)->items + (vec)->len, (src), _carr_n * sizeof((vec)->items[0])    \
+    );                                                                         \
+    (vec)->len += _carr_n;                                                     \
+} while (0)
+
+// Sets the length of the vec to n. The new items are zeroed.
+#define carr_vec_resize(vec, n)                                                \
 do {                                                                           \
-    size_t new_cap = carr_vec_grow_cap((vec));                                 \
-    carr_vec_realloc((vec), new_cap);                                          \
-    (vec)->cap = new_cap;                                                      \
+    size_t _carr_len = (n);                                                    \
+    if (_carr_len > (vec)->len) {                                              \
+        carr_vec_reserve((vec), _carr_len - (vec)->len);                       \
+        memset(                                                                \
+            (vec)->items + (vec)->len, 0,                                      \
+            (_carr_len - (vec)->len) * sizeof((vec)->items[0])                 \
+        );                                                                     \
+    }                                                                          \
+    (vec)->len = _carr_len;                                                    \
 } while (0)
 
 #define carr_vec_new(vec_type)                                                 \
@@ -93,14 +217,16 @@ do {                                                                           \
 
 #define carr_vec_free(vec)                                                     \
 do {                                                                           \
-    free((vec)->items);                                                        \
+    _carr_vec_assert_not_inline((vec));                                        \
+    _carr_vec_items_free((vec));                                               \
     (vec)->items = NULL;                                                       \
+    (vec)->len   = 0;                                                          \
+    (vec)->cap   = 0;                                                          \
 } while (0)
 
 #define carr_vec_clone(dst, src)                                               \
 do {                                                                           \
-    carr_vec_realloc((dst), (src)->cap);                                       \
-    (dst)->cap = (src)->cap;                                                   \
+    carr_vec_realloc((dst), (src)->len);                                       \
     (dst)->len = (src)->len;                                                   \
     memcpy((dst)->items, (src)->items, (src)->len * sizeof((src)->items[0]));  \
 } while (0)
@@ -178,19 +304,597 @@ do {                                                                           \
         );                                                                     \
         exit(2);                                                               \
     }                                                                          \
-    size_t idx = (vec)->len - 1;                                               \
-    *(res) = carr_vec_at((vec), idx);                                          \
-    carr_vec_delete((vec), idx);                                               \
+    *(res) = (vec)->items[--(vec)->len];                                       \
+} while (0)
+
+// Deletes the item at idx by moving the last item into its place, so it
+// does not keep the order of the items, but does not move the rest either.
+#define carr_vec_swap_remove(vec, idx)                                         \
+do {                                                                           \
+    size_t _carr_idx = (idx);                                                  \
+    if (_carr_idx >= (vec)->len) {                                             \
+        break;                                                                 \
+    }                                                                          \
+    (vec)->items[_carr_idx] = (vec)->items[--(vec)->len];                      \
+} while (0)
+
+// Deletes the items in [start, end) with a single move of the tail.
+#define carr_vec_delete_range(vec, start, end)                                 \
+do {                                                                           \
+    size_t _carr_start = (start);                                              \
+    size_t _carr_end   = (end) < (vec)->len ? (end) : (vec)->len;              \
+    if (_carr_start >= _carr_end) {                                            \
+        break;                                                                 \
+    }                                                                          \
+    memmove(                                                                   \
+        (vec)->items + _carr_start, (vec)->items + _carr_end,                  \
+        ((vec)->len - _carr_end) * sizeof((vec)->items[0])                     \
+    );                                                                         \
+    (vec)->len -= _carr_end - _carr_start;                                     \
+} while (0)
+
+// Keeps only the items for which pred(&item) is true, in their order,
+// moving every kept item at most once. pred can be a function or a macro.
+#define carr_vec_retain(vec, pred)                                             \
+do {                                                                           \
+    size_t _carr_kept = 0;                                                     \
+    for (size_t _carr_i = 0; _carr_i < (vec)->len; ++_carr_i) {                \
+        if (pred(&(vec)->items[_carr_i])) {                                    \
+            if (_carr_kept != _carr_i) {                                       \
+                (vec)->items[_carr_kept] = (vec)->items[_carr_i];              \
+            }                                                                  \
+            _carr_kept++;                                                      \
+        }                                                                      \
+    }                                                                          \
+    (vec)->len = _carr_kept;                                                   \
 } while (0)
 
 #define carr_vec_swap(vec, i, j)                                               \
 do {                                                                           \
-    carr_vec_append((vec), carr_vec_at((vec), (i)));                           \
-    (vec)->items[(i)] = carr_vec_at((vec), (j));                               \
-    (vec)->items[(j)] = carr_vec_at((vec), (vec)->len-1);                      \
-    (vec)->len--;                                                              \
+    _carr_vec_assert((vec), (i));                                              \
+    _carr_vec_assert((vec), (j));                                              \
+    _carr_vec_swap((vec), (i), (j));                                           \
+} while (0)
+
+// Swaps through a temporary the size of an item, so it never touches the
+// vec's memory beyond the two items.
+#define _carr_vec_swap(vec, i, j)                                              \
+do {                                                                           \
+    unsigned char _carr_tmp[sizeof((vec)->items[0])];                          \
+    memcpy(_carr_tmp, &(vec)->items[(i)], sizeof(_carr_tmp));                  \
+    (vec)->items[(i)] = (vec)->items[(j)];                                     \
+    memcpy(&(vec)->items[(j)], _carr_tmp, sizeof(_carr_tmp));                  \
+} while (0)
+
+
+
+
+/*-----------------------------------------------------------------------------+
+ *                                                                             *
+ *                           SMALL VEC STUFF                                   *
+ *                                                                             *
+ +-----------------------------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------------+
+ *                                                                             *
+ *  CARR_SMALL_VEC_DEFINE(Name, T, N) defines a vec of T that keeps its first  *
+ *  N items inside the struct, and only moves them to the heap when an         *
+ *  append overflows them:                                                     *
+ *  typedef struct {                                                           *
+ *       T*     items                                                          *
+ *       size_t len                                                            *
+ *       size_t cap                                                            *
+ *       T      inline_items[N]                                                *
+ *  } Name;                                                                    *
+ *  After carr_small_vec_init, the vec_* macros that never allocate or free    *
+ *  (vec_at, vec_pop, vec_delete, vec_retain, the sorts, ...) work on it as    *
+ *  usual. Growing and freeing it go through the small_vec_* macros below,     *
+ *  which know about the inline items, so the plain vec_* stay as they are.    *
+ *  Those assert, unless NDEBUG is defined, that they are not handed inline    *
+ *  items.                                                                     *
+ *  items points inside the struct itself, so a small vec must not be copied   *
+ *  or moved by value while its items are inline.                              *
+ *                                                                             *
+ +-----------------------------------------------------------------------------*/
+
+#define CARR_SMALL_VEC_DEFINE(Name, T, N)                                      \
+typedef struct {                                                               \
+    T*     items;                                                              \
+    size_t len;                                                                \
+    size_t cap;                                                                \
+    T      inline_items[N];                                                    \
+} Name
+
+#define carr_small_vec_init(vec)                                               \
+do {                                                                           \
+    (vec)->items = (vec)->inline_items;                                        \
+    (vec)->len   = 0;                                                          \
+    (vec)->cap   = sizeof((vec)->inline_items) / sizeof((vec)->items[0]);      \
+} while (0)
+
+// True while the items are still the inline ones.
+#define carr_small_vec_is_inline(vec)                                          \
+    ((vec)->items == (vec)->inline_items)
+
+// As carr_vec_realloc. The inline items are copied to the heap the first
+// time they overflow, and the growth goes on from N.
+#define carr_small_vec_realloc(vec, new_cap)                                   \
+do {                                                                           \
+    size_t _carr_new_cap = (new_cap);                                          \
+    if ((vec)->cap >= _carr_new_cap) {                                         \
+        break;                                                                 \
+    }                                                                          \
+    size_t _carr_bytes = _carr_new_cap * sizeof((vec)->items[0]);              \
+    if (carr_small_vec_is_inline((vec))) {                                     \
+        void* _carr_heap = CARR_MALLOC(_carr_bytes);                           \
+        memcpy(_carr_heap, (vec)->items, (vec)->len * sizeof((vec)->items[0]));\
+        (vec)->items = _carr_heap;                                             \
+    } else {                                                                   \
+        (vec)->items = CARR_REALLOC((vec)->items, _carr_bytes);                \
+    }                                                                          \
+    (vec)->cap = _carr_new_cap;                                                \
+} while (0)
+
+#define carr_small_vec_reserve(vec, n)                                         \
+do {                                                                           \
+    size_t _carr_needed = (vec)->len + (n);                                    \
+    if (_carr_needed > (vec)->cap) {                                           \
+        carr_small_vec_realloc(                                                \
+            (vec), _carr_vec_next_cap((vec)->cap, _carr_needed)                \
+        );                                                                     \
+    }                                                                          \
+} while (0)
+
+#define carr_small_vec_append(vec, item)                                       \
+do {                                                                           \
+    if ((vec)->len + 1 > (vec)->cap) {                                         \
+        carr_small_vec_realloc((vec), carr_vec_grow_cap((vec)));               \
+    }                                                                          \
+    (vec)->items[(vec)->len++] = item;                                         \
+} while (0)
+
+#define carr_small_vec_extend(vec, src, n)                                     \
+do {                                                                           \
+    size_t _carr_n = (n);                                                      \
+    carr_small_vec_reserve((vec), _carr_n);                                    \
+    memcpy(                                                                    \
+        (vec)->items + (vec)->len, (src), _carr_n * sizeof((vec)->items[0])    \
+    );                                                                         \
+    (vec)->len += _carr_n;                                                     \
+} while (0)
+
+// Frees the heap items, if any, and leaves the vec empty and inline.
+#define carr_small_vec_free(vec)                                               \
+do {                                                                           \
+    if (!carr_small_vec_is_inline((vec))) {                                    \
+        CARR_FREE((vec)->items);                                               \
+    }                                                                          \
+    carr_small_vec_init((vec));                                                \
+} while (0)
+
+
+
+
+/*-----------------------------------------------------------------------------+
+ *                                                                             *
+ *                           SORT STUFF                                        *
+ *                                                                             *
+ +-----------------------------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------------+
+ *                                                                             *
+ *  CARR_VEC_SORT_DEFINE(Name, T, less) generates, for arrays of T:            *
+ *      void   Name##_sort(T* items, size_t len)         introsort             *
+ *      void   Name##_stable_sort(T* items, size_t len)  merge sort            *
+ *      size_t Name##_lower_bound(const T* items, size_t len, T key)           *
+ *      size_t Name##_upper_bound(const T* items, size_t len, T key)           *
+ *  less(a, b) takes two T values and tells whether a goes before b. It can    *
+ *  be a macro, so the comparisons are inlined instead of being calls          *
+ *  through a pointer as with qsort.                                           *
+ *                                                                             *
+ *  CARR_VEC_RADIX_SORT_DEFINE(Name, T, key) generates                         *
+ *      void   Name##_radix_sort(T* items, size_t len)                         *
+ *  a stable LSD radix sort on key(item), a uint64_t whose unsigned order is   *
+ *  the wanted one. The carr_radix_key_* helpers map the usual integer and     *
+ *  float types to such keys.                                                  *
+ *                                                                             *
+ *  The carr_vec_* wrappers below call them on a whole vec.                    *
+ *                                                                             *
+ +-----------------------------------------------------------------------------*/
+
+// Slices up to this length are sorted by insertion.
+#ifndef CARR_SORT_INSERTION_THRESHOLD
+#define CARR_SORT_INSERTION_THRESHOLD 24
+#endif // CARR_SORT_INSERTION_THRESHOLD
+
+#define carr_vec_sort(vec, Name)                                               \
+    Name##_sort((vec)->items, (vec)->len)
+#define carr_vec_stable_sort(vec, Name)                                        \
+    Name##_stable_sort((vec)->items, (vec)->len)
+#define carr_vec_radix_sort(vec, Name)                                         \
+    Name##_radix_sort((vec)->items, (vec)->len)
+#define carr_vec_lower_bound(vec, Name, key)                                   \
+    Name##_lower_bound((vec)->items, (vec)->len, (key))
+#define carr_vec_upper_bound(vec, Name, key)                                   \
+    Name##_upper_bound((vec)->items, (vec)->len, (key))
+
+static inline uint64_t carr_radix_key_u64(uint64_t x)
+{
+    return x;
+}
+
+static inline uint64_t carr_radix_key_i64(int64_t x)
+{
+    return (uint64_t)x ^ (1ull << 63);
+}
+
+static inline uint64_t carr_radix_key_i32(int32_t x)
+{
+    return (uint32_t)x ^ 0x80000000u;
+}
+
+// Negative floats have their bits flipped, so they sort backwards, below
+// the positive ones.
+static inline uint64_t carr_radix_key_f64(double x)
+{
+    uint64_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    return (bits >> 63) ? ~bits : bits | (1ull << 63);
+}
+
+static inline uint64_t carr_radix_key_f32(float x)
+{
+    uint32_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    return (bits >> 31) ? (uint32_t)~bits : bits | 0x80000000u;
+}
+
+#define CARR_VEC_SORT_DEFINE(Name, T, less)                                    \
+static inline void Name##_insertion_sort(T* a, size_t n)                       \
+{                                                                              \
+    for (size_t i = 1; i < n; ++i) {                                           \
+        T      x = a[i];                                                       \
+        size_t j = i;                                                          \
+        while (j > 0 && less(x, a[j - 1])) {                                   \
+            a[j] = a[j - 1];                                                   \
+            j--;                                                               \
+        }                                                                      \
+        a[j] = x;                                                              \
+    }                                                                          \
+}                                                                              \
+                                                                               \
+static inline void Name##_heap_sort(T* a, size_t n)                            \
+{                                                                              \
+    for (size_t end = n, k = n / 2; end > 1;) {                                \
+        if (k > 0) {                                                           \
+            k--;                                                               \
+        } else {                                                               \
+            end--;                                                             \
+            T t = a[0]; a[0] = a[end]; a[end] = t;                             \
+        }                                                                      \
+        T      x = a[k];                                                       \
+        size_t i = k;                                                          \
+        for (size_t c = 2 * i + 1; c < end; c = 2 * i + 1) {                   \
+            if (c + 1 < end && less(a[c], a[c + 1])) {                         \
+                c++;                                                           \
+            }                                                                  \
+            if (!less(x, a[c])) {                                              \
+                break;                                                         \
+            }                                                                  \
+            a[i] = a[c];                                                       \
+            i    = c;                                                          \
+        }                                                                      \
+        a[i] = x;                                                              \
+    }                                                                          \
+}                                                                              \
+                                                                               \
+/* Orders a[i] <= a[j] <= a[k]. */                                             \
+static inline void Name##_sort3(T* a, size_t i, size_t j, size_t k)            \
+{                                                                              \
+    T t;                                                                       \
+    if (less(a[j], a[i])) { t = a[i]; a[i] = a[j]; a[j] = t; }                 \
+    if (less(a[k], a[j])) {                                                    \
+        t = a[j]; a[j] = a[k]; a[k] = t;                                       \
+        if (less(a[j], a[i])) { t = a[i]; a[i] = a[j]; a[j] = t; }             \
+    }                                                                          \
+}                                                                              \
+                                                                               \
+/* Partitions a (at least 3 items) around a median of 3, or a ninther    */    \
+/* for big slices, so a[0, *left) <= pivot <= a[*right, n) and both     */     \
+/* sides are shorter than n.                                            */     \
+static inline void Name##_partition(T* a, size_t n, size_t* left, size_t* right)\
+{                                                                              \
+    size_t mid = n / 2;                                                        \
+    if (n > 128) {                                                             \
+        size_t s = n / 8;                                                      \
+        Name##_sort3(a, 1, s, 2 * s);                                          \
+        Name##_sort3(a, mid - s, mid - 1, mid + s);                            \
+        Name##_sort3(a, n - 1 - 2 * s, n - 1 - s, n - 2);                      \
+        Name##_sort3(a, s, mid - 1, n - 1 - s);                                \
+        T t = a[mid]; a[mid] = a[mid - 1]; a[mid - 1] = t;                     \
+    }                                                                          \
+    /* a[0] <= pivot <= a[n - 1] keep both scans inside the slice. */          \
+    Name##_sort3(a, 0, mid, n - 1);                                            \
+    T pivot = a[mid];                                                          \
+                                                                               \
+    size_t i = 0, j = n - 1;                                                   \
+    for (;;) {                                                                 \
+        while (less(a[i], pivot)) i++;                                         \
+        while (less(pivot, a[j])) j--;                                         \
+        if (i >= j) {                                                          \
+            break;                                                             \
+        }                                                                      \
+        T t = a[i]; a[i] = a[j]; a[j] = t;                                     \
+        i++;                                                                   \
+        j--;                                                                   \
+    }                                                                          \
+    *left  = i;                                                                \
+    *right = j + 1;                                                            \
+}                                                                              \
+                                                                               \
+/* Quicksort on the smaller side, iterating on the bigger one, and heap  */    \
+/* sort once depth runs out, so the worst case stays O(n log n).         */    \
+static inline void Name##_intro_sort(T* a, size_t n, size_t depth)             \
+{                                                                              \
+    while (n > CARR_SORT_INSERTION_THRESHOLD) {                                \
+        if (depth == 0) {                                                      \
+            Name##_heap_sort(a, n);                                            \
+            return;                                                            \
+        }                                                                      \
+        depth--;                                                               \
+                                                                               \
+        size_t left, right;                                                    \
+        Name##_partition(a, n, &left, &right);                                 \
+        if (left < n - right) {                                                \
+            Name##_intro_sort(a, left, depth);                                 \
+            a += right;                                                        \
+            n -= right;                                                        \
+        } else {                                                               \
+            Name##_intro_sort(a + right, n - right, depth);                    \
+            n = left;                                                          \
+        }                                                                      \
+    }                                                                          \
+    Name##_insertion_sort(a, n);                                               \
+}                                                                              \
+                                                                               \
+static inline void Name##_sort(T* a, size_t n)                                 \
+{                                                                              \
+    size_t depth = 0;                                                          \
+    for (size_t m = n; m > 1; m >>= 1) {                                       \
+        depth += 2;                                                            \
+    }                                                                          \
+    Name##_intro_sort(a, n, depth);                                            \
+}                                                                              \
+                                                                               \
+/* Bottom-up merge sort over runs sorted by insertion, ping-ponging   */       \
+/* between a and a buffer of n items.                                 */       \
+static inline void Name##_stable_sort(T* a, size_t n)                          \
+{                                                                              \
+    const size_t run = 32;                                                     \
+    for (size_t lo = 0; lo < n; lo += run) {                                   \
+        Name##_insertion_sort(a + lo, n - lo < run ? n - lo : run);            \
+    }                                                                          \
+    if (n <= run) {                                                            \
+        return;                                                                \
+    }                                                                          \
+                                                                               \
+    T* buf = (T*)CARR_MALLOC(n * sizeof(T));                                   \
+    T* src = a;                                                                \
+    T* dst = buf;                                                              \
+    for (size_t width = run; width < n; width *= 2) {                          \
+        for (size_t lo = 0; lo < n; lo += 2 * width) {                         \
+            size_t mid = lo + width < n ? lo + width : n;                      \
+            size_t hi  = lo + 2 * width < n ? lo + 2 * width : n;              \
+            size_t i = lo, j = mid, k = lo;                                    \
+            if (mid == hi || !less(src[mid], src[mid - 1])) {                  \
+                memcpy(dst + lo, src + lo, (hi - lo) * sizeof(T));             \
+                continue;                                                      \
+            }                                                                  \
+            while (i < mid && j < hi) {                                        \
+                dst[k++] = less(src[j], src[i]) ? src[j++] : src[i++];         \
+            }                                                                  \
+            memcpy(dst + k, src + i, (mid - i) * sizeof(T));                   \
+            memcpy(dst + k + (mid - i), src + j, (hi - j) * sizeof(T));        \
+        }                                                                      \
+        T* t = src; src = dst; dst = t;                                        \
+    }                                                                          \
+    if (src != a) {                                                            \
+        memcpy(a, src, n * sizeof(T));                                         \
+    }                                                                          \
+    CARR_FREE(buf);                                                            \
+}                                                                              \
+                                                                               \
+/* Index of the first item not before key. The loop has a fixed number */      \
+/* of steps for a given len and no branch on the comparison.           */      \
+static inline size_t Name##_lower_bound(const T* a, size_t n, T key)           \
+{                                                                              \
+    if (n == 0) {                                                              \
+        return 0;                                                              \
+    }                                                                          \
+    const T* base = a;                                                         \
+    while (n > 1) {                                                            \
+        size_t half = n / 2;                                                   \
+        base = less(base[half], key) ? base + half : base;                     \
+        n   -= half;                                                           \
+    }                                                                          \
+    return (base - a) + (less(*base, key) ? 1 : 0);                            \
+}                                                                              \
+                                                                               \
+/* Index of the first item after key. */                                       \
+static inline size_t Name##_upper_bound(const T* a, size_t n, T key)           \
+{                                                                              \
+    if (n == 0) {                                                              \
+        return 0;                                                              \
+    }                                                                          \
+    const T* base = a;                                                         \
+    while (n > 1) {                                                            \
+        size_t half = n / 2;                                                   \
+        base = less(key, base[half]) ? base : base + half;                     \
+        n   -= half;                                                           \
+    }                                                                          \
+    return (base - a) + (less(key, *base) ? 0 : 1);                            \
+}
+
+#define CARR_VEC_RADIX_SORT_DEFINE(Name, T, key)                               \
+/* One pass counts the 8 digits of every key. Digits shared by all the */      \
+/* keys (like the high bytes of small numbers) get no pass of their own. */    \
+static inline void Name##_radix_sort(T* a, size_t n)                           \
+{                                                                              \
+    if (n < 2) {                                                               \
+        return;                                                                \
+    }                                                                          \
+    static _Thread_local size_t counts[8][256];                                \
+    memset(counts, 0, sizeof(counts));                                         \
+    for (size_t i = 0; i < n; ++i) {                                           \
+        uint64_t k = key(a[i]);                                                \
+        for (int d = 0; d < 8; ++d) {                                          \
+            counts[d][(k >> (8 * d)) & 0xFF]++;                                \
+        }                                                                      \
+    }                                                                          \
+                                                                               \
+    uint64_t k0  = key(a[0]);                                                  \
+    T*       buf = (T*)CARR_MALLOC(n * sizeof(T));                             \
+    T*       src = a;                                                          \
+    T*       dst = buf;                                                        \
+    for (int d = 0; d < 8; ++d) {                                              \
+        if (counts[d][(k0 >> (8 * d)) & 0xFF] == n) {                          \
+            continue;                                                          \
+        }                                                                      \
+        size_t offset = 0;                                                     \
+        for (int b = 0; b < 256; ++b) {                                        \
+            size_t c = counts[d][b];                                           \
+            counts[d][b] = offset;                                             \
+            offset += c;                                                       \
+        }                                                                      \
+        for (size_t i = 0; i < n; ++i) {                                       \
+            dst[counts[d][(key(src[i]) >> (8 * d)) & 0xFF]++] = src[i];        \
+        }                                                                      \
+        T* t = src; src = dst; dst = t;                                        \
+    }                                                                          \
+    if (src != a) {                                                            \
+        memcpy(a, src, n * sizeof(T));                                         \
+    }                                                                          \
+    CARR_FREE(buf);                                                            \
+}
+
+
+
+
+/*-----------------------------------------------------------------------------+
+ *                                                                             *
+ *                           SEGMENTED VEC STUFF                               *
+ *                                                                             *
+ +-----------------------------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------------+
+ *                                                                             *
+ *  All the segvec_* macros assume a struct in the form:                       *
+ *  typedef struct {                                                           *
+ *       T*     blocks[CARR_SEGVEC_MAX_BLOCKS]                                 *
+ *       size_t len                                                            *
+ *  } SomeUserStruct;                                                          *
+ *  Block k holds CARR_SEGVEC_BASE << k items, so the blocks double in size    *
+ *  like the capacity of a vec, but growing only allocates the next block:     *
+ *  the items never move, pointers to them stay valid as long as they are in   *
+ *  the segvec, and no growth ever copies the whole thing.                     *
+ *  Item i lives in block log2(i / CARR_SEGVEC_BASE + 1), which takes a        *
+ *  single count-leading-zeros instruction to find.                            *
+ *                                                                             *
+ +-----------------------------------------------------------------------------*/
+
+// Must be a power of two.
+#ifndef CARR_SEGVEC_BASE
+#define CARR_SEGVEC_BASE 256
+#endif // CARR_SEGVEC_BASE
+
+// Enough for CARR_SEGVEC_BASE * (2^48 - 1) items.
+#ifndef CARR_SEGVEC_MAX_BLOCKS
+#define CARR_SEGVEC_MAX_BLOCKS 48
+#endif // CARR_SEGVEC_MAX_BLOCKS
+
+static inline size_t _carr_segvec_block(size_t idx)
+{
+    unsigned long long j = idx / CARR_SEGVEC_BASE + 1;
+    return (size_t)(63 - __builtin_clzll(j));
+}
+
+static inline size_t _carr_segvec_offset(size_t idx, size_t block)
+{
+    return idx + CARR_SEGVEC_BASE - ((size_t)CARR_SEGVEC_BASE << block);
+}
+
+#define carr_segvec_init(sv)                                                   \
+do {                                                                           \
+    memset((sv)->blocks, 0, sizeof((sv)->blocks));                             \
+    (sv)->len = 0;                                                             \
+} while (0)
+
+#define carr_segvec_free(sv)                                                   \
+do {                                                                           \
+    for (size_t _carr_k = 0; _carr_k < CARR_SEGVEC_MAX_BLOCKS; ++_carr_k) {    \
+        CARR_FREE((sv)->blocks[_carr_k]);                                      \
+        (sv)->blocks[_carr_k] = NULL;                                          \
+    }                                                                          \
+    (sv)->len = 0;                                                             \
+} while (0)
+
+#define _carr_segvec_at(sv, idx)                                               \
+    (sv)->blocks[_carr_segvec_block(idx)]                                      \
+        [_carr_segvec_offset((idx), _carr_segvec_block(idx))]
+
+#define carr_segvec_at(sv, idx)                                                \
+    (_carr_vec_assert((sv), (idx)), _carr_segvec_at((sv), (idx)))
+
+// Pointer to item idx, valid until the item is popped.
+#define carr_segvec_ptr(sv, idx)                                               \
+    (_carr_vec_assert((sv), (idx)), &_carr_segvec_at((sv), (idx)))
+
+#define carr_segvec_append(sv, item)                                           \
+do {                                                                           \
+    size_t _carr_k = _carr_segvec_block((sv)->len);                            \
+    if ((sv)->blocks[_carr_k] == NULL) {                                       \
+        (sv)->blocks[_carr_k] = CARR_MALLOC(                                   \
+            ((size_t)CARR_SEGVEC_BASE << _carr_k) * sizeof((sv)->blocks[0][0]) \
+        );                                                                     \
+    }                                                                          \
+    (sv)->blocks[_carr_k][_carr_segvec_offset((sv)->len, _carr_k)] = item;     \
+    (sv)->len++;                                                               \
+} while (0)
+
+// Keeps the blocks, so appending again after a pop never allocates.
+#define carr_segvec_pop(sv, res)                                               \
+do {                                                                           \
+    if ((sv)->len == 0) {                                                      \
+        printf(                                                                \
+            "ERROR:%s:%d Cannot pop item out of an empty segvec\n",            \
+            __FILE_NAME__, __LINE__                                            \
+        );                                                                     \
+        exit(2);                                                               \
+    }                                                                          \
+    (sv)->len--;                                                               \
+    *(res) = _carr_segvec_at((sv), (sv)->len);                                 \
 } while (0)
 
+// Loops over the blocks in order, with ptr (declared by the caller)
+// pointing to the items of the block and n (declared by the loop) their
+// number, as in:
+//     int* block;
+//     carr_segvec_foreach_block(&sv, block, n) {
+//         for (size_t i = 0; i < n; ++i) use(block[i]);
+//     }
+#define carr_segvec_foreach_block(sv, ptr, n)                                  \
+    for (                                                                      \
+        size_t _carr_k = 0, _carr_start = 0, n = 0;                            \
+        _carr_start < (sv)->len && (                                           \
+            (ptr) = (sv)->blocks[_carr_k],                                     \
+            n = (sv)->len - _carr_start,                                       \
+            n = n < ((size_t)CARR_SEGVEC_BASE << _carr_k)                      \
+                ? n : ((size_t)CARR_SEGVEC_BASE << _carr_k),                   \
+            true                                                               \
+        );                                                                     \
+        _carr_start += (size_t)CARR_SEGVEC_BASE << _carr_k, _carr_k++          \
+    )
+
 
 
 
@@ -225,12 +929,13 @@ do {                                                                           \
 // In a MaxHeap, that would translate to a > b.
 // In a MinHeap, a < b.
 // The arguments are defined as void* to allow for arbitrary user structs.
-// The file [examples/heap_queue.c] provides a complete example.
+// The file [examples/50-heap_queue.c] provides a complete example.
+// CARR_HEAP_DEFINE below does the same with the comparison inlined.
 typedef bool(*CarrHeapCompareFunction)(void* a, void* b);
 
-#define carr_heap_parent(i) (i - 1) >> 1
-#define carr_heap_left(i)   ((i) << 1) | 1
-#define carr_heap_right(i)  ((i + 1) << 1)
+#define carr_heap_parent(i) (((i) - 1) >> 1)
+#define carr_heap_left(i)   (((i) << 1) | 1)
+#define carr_heap_right(i)  (((i) + 1) << 1)
 
 
 #define carr_heap_new(vec, func)                                               \
@@ -240,67 +945,72 @@ do {                                                                           \
     (vec)->compare = func;                                                     \
 } while (0) 
 
+// Sifts the item at idx down to its place. Neither this nor the other
+// heap_* macros allocate, except for heap_push when the vec is full.
 #define carr_heap_balance(h, idx)                                              \
 do {                                                                           \
-    struct { size_t* items; size_t  len; size_t  cap; } stack;                 \
-    carr_vec_init(&stack);                                                     \
-    carr_vec_grow(&stack);                                                     \
-    carr_vec_append(&stack, idx);                                              \
-                                                                               \
-    while (stack.len > 0) {                                                    \
-        size_t cur;                                                            \
-        carr_vec_pop(&stack, &cur);                                            \
-                                                                               \
-        size_t l    = carr_heap_left(cur);                                     \
-        size_t r    = carr_heap_right(cur);                                    \
-        size_t best = cur;                                                     \
-                                                                               \
+    size_t _carr_cur = (idx);                                                  \
+    for (;;) {                                                                 \
+        size_t _carr_l    = carr_heap_left(_carr_cur);                         \
+        size_t _carr_best = _carr_cur;                                         \
         if (                                                                   \
-            l < (h)->len &&                                                    \
+            _carr_l < (h)->len &&                                              \
             (h)->compare(                                                      \
-                (void*)&_carr_vec_at((h), l),                                  \
-                (void*)&_carr_vec_at((h), best)                                \
+                (void*)&_carr_vec_at((h), _carr_l),                            \
+                (void*)&_carr_vec_at((h), _carr_best)                          \
             )                                                                  \
         ) {                                                                    \
-            best = l;                                                          \
+            _carr_best = _carr_l;                                              \
         }                                                                      \
-                                                                               \
         if (                                                                   \
-            r < (h)->len &&                                                    \
+            _carr_l + 1 < (h)->len &&                                          \
             (h)->compare(                                                      \
-                (void*)&_carr_vec_at((h), r),                                  \
-                (void*)&_carr_vec_at((h), best)                                \
+                (void*)&_carr_vec_at((h), _carr_l + 1),                        \
+                (void*)&_carr_vec_at((h), _carr_best)                          \
             )                                                                  \
         ) {                                                                    \
-            best = r;                                                          \
+            _carr_best = _carr_l + 1;                                          \
         }                                                                      \
-                                                                               \
-        if (best != cur) {                                                     \
-            carr_vec_swap((h), cur, best);                                     \
-            carr_vec_append(&stack, best);                                     \
+        if (_carr_best == _carr_cur) {                                         \
+            break;                                                             \
         }                                                                      \
+        _carr_vec_swap((h), _carr_cur, _carr_best);                            \
+        _carr_cur = _carr_best;                                                \
     }                                                                          \
 } while (0)
 
-#define carr_heap_increase(h, idx, value)                                      \
+// Sifts the item at idx up to its place.
+#define _carr_heap_sift_up(h, idx)                                             \
 do {                                                                           \
-    h->items[(idx)] = value;                                                   \
-    size_t par = carr_heap_parent((idx));                                      \
-    while (                                                                    \
-        par > 0 &&                                                             \
-        (h)->compare(carr_vec_at((h), par), carr_vec_at((h), (idx)))           \
-    ) {                                                                        \
-        carr_vec_swap((h), (idx), par);                                        \
-        par = carr_heap_parent(par);                                           \
+    size_t _carr_cur = (idx);                                                  \
+    while (_carr_cur > 0) {                                                    \
+        size_t _carr_par = carr_heap_parent(_carr_cur);                        \
+        if (                                                                   \
+            !(h)->compare(                                                     \
+                (void*)&_carr_vec_at((h), _carr_cur),                          \
+                (void*)&_carr_vec_at((h), _carr_par)                           \
+            )                                                                  \
+        ) {                                                                    \
+            break;                                                             \
+        }                                                                      \
+        _carr_vec_swap((h), _carr_cur, _carr_par);                             \
+        _carr_cur = _carr_par;                                                 \
     }                                                                          \
 } while (0)
 
+// Replaces the item at idx by a 'greater' value.
+#define carr_heap_increase(h, idx, value)                                      \
+do {                                                                           \
+    _carr_vec_assert((h), (idx));                                              \
+    (h)->items[(idx)] = (value);                                               \
+    _carr_heap_sift_up((h), (idx));                                            \
+} while (0)
+
 
 #define carr_heapfy(vec)                                                       \
 do {                                                                           \
-    int start = (vec)->len / 2 - 1;                                            \
-    for (int i = start; i >= 0; i--) {                                         \
-        carr_heap_balance((vec), i);                                           \
+    for (size_t _carr_i = (vec)->len / 2; _carr_i-- > 0;) {                    \
+        carr_heap_balance((vec), _carr_i);                                     \
     }                                                                          \
 } while (0)
 
@@ -308,21 +1018,659 @@ do {                                                                           \
 #define carr_heap_push(h, value)                                               \
 do {                                                                           \
     carr_vec_append((h), (value));                                             \
-    carr_heap_increase((h), (h)->len-1, (value));                              \
-} while (0)                                                                    \
+    _carr_heap_sift_up((h), (h)->len - 1);                                     \
+} while (0)
 
 
 #define carr_heap_pop(h, res)                                                  \
 do {                                                                           \
-    if ((h)->len == 1) {                                                       \
-        carr_vec_pop((h), (res));                                              \
-        break;                                                                 \
+    if ((h)->len > 1) {                                                        \
+        _carr_vec_swap((h), (size_t)0, (h)->len - 1);                          \
     }                                                                          \
-    size_t last = (h)->len-1;                                                  \
-    carr_vec_swap((h), (size_t)0, last);                                       \
     carr_vec_pop((h), (res));                                                  \
     carr_heap_balance((h), 0);                                                 \
-} while (0)                                                                    \
+} while (0)
+
+
+// Pushes the n items of the array src. When n is at least the current
+// size of the heap, the items are appended and the whole heap is rebuilt
+// with heapfy, which is linear, instead of sifting each of them up.
+#define carr_heap_push_many(h, src, n)                                         \
+do {                                                                           \
+    size_t _carr_old = (h)->len;                                               \
+    carr_vec_extend((h), (src), (n));                                          \
+    if ((h)->len - _carr_old >= _carr_old) {                                   \
+        carr_heapfy((h));                                                      \
+    } else {                                                                   \
+        for (size_t _carr_j = _carr_old; _carr_j < (h)->len; ++_carr_j) {      \
+            _carr_heap_sift_up((h), _carr_j);                                  \
+        }                                                                      \
+    }                                                                          \
+} while (0)
+
+// Pops the k top items, or all of them if there are fewer, into the array
+// dst, in order.
+#define carr_heap_pop_k(h, dst, k)                                             \
+do {                                                                           \
+    size_t _carr_kk = (k);                                                     \
+    size_t _carr_k  = _carr_kk < (h)->len ? _carr_kk : (h)->len;               \
+    for (size_t _carr_j = 0; _carr_j < _carr_k; ++_carr_j) {                   \
+        carr_heap_pop((h), &(dst)[_carr_j]);                                   \
+    }                                                                          \
+} while (0)
+
+
+/*-----------------------------------------------------------------------------+
+ *                                                                             *
+ *  CARR_HEAP_DEFINE(Name, T, higher) generates, for arrays of T:              *
+ *      void Name##_sift_up(T* items, size_t idx)                              *
+ *      void Name##_sift_down(T* items, size_t len, size_t idx)                *
+ *      void Name##_heapfy(T* items, size_t len)                               *
+ *  higher(a, b) takes two T values and tells whether a goes above b, like     *
+ *  a CarrHeapCompareFunction. It can be a macro, so the comparisons are       *
+ *  inlined instead of being calls through a pointer. The sifts move a hole    *
+ *  instead of swapping, so each level costs a single copy.                    *
+ *                                                                             *
+ *  CARR_DARY_HEAP_DEFINE(Name, T, higher, D) generates the same functions     *
+ *  for a D-ary heap, where the children of i are the D items from D*i + 1.    *
+ *  A 4 or 8-ary heap is half or a third as deep as a binary one, and the      *
+ *  children compared at each level of a sift-down sit next to each other,     *
+ *  in a single cache line when D * sizeof(T) fits one (and the line is not    *
+ *  straddled, see CARR_ALIGNED_DARY_HEAP_DEFINE). That trades a few more      *
+ *  comparisons for far fewer cache misses once the heap outgrows the caches.  *
+ *  A sift-up does fewer levels too, so pushes get cheaper as well.            *
+ *                                                                             *
+ *  The carr_typed_heap_* wrappers below work on a plain vec with them, no     *
+ *  compare field needed, like the heap_* macros do with the compare field.    *
+ *                                                                             *
+ +-----------------------------------------------------------------------------*/
+
+#define carr_typed_heapfy(vec, Name)                                           \
+    Name##_heapfy((vec)->items, (vec)->len)
+
+#define carr_typed_heap_push(h, Name, value)                                   \
+do {                                                                           \
+    carr_vec_append((h), (value));                                             \
+    Name##_sift_up((h)->items, (h)->len - 1);                                  \
+} while (0)
+
+#define carr_typed_heap_pop(h, Name, res)                                      \
+do {                                                                           \
+    if ((h)->len > 1) {                                                        \
+        _carr_vec_swap((h), (size_t)0, (h)->len - 1);                          \
+    }                                                                          \
+    carr_vec_pop((h), (res));                                                  \
+    if ((h)->len > 1) {                                                        \
+        Name##_sift_down((h)->items, (h)->len, 0);                             \
+    }                                                                          \
+} while (0)
+
+#define carr_typed_heap_increase(h, Name, idx, value)                          \
+do {                                                                           \
+    _carr_vec_assert((h), (idx));                                              \
+    (h)->items[(idx)] = (value);                                               \
+    Name##_sift_up((h)->items, (idx));                                         \
+} while (0)
+
+#define carr_typed_heap_push_many(h, Name, src, n)                             \
+do {                                                                           \
+    size_t _carr_old = (h)->len;                                               \
+    carr_vec_extend((h), (src), (n));                                          \
+    if ((h)->len - _carr_old >= _carr_old) {                                   \
+        Name##_heapfy((h)->items, (h)->len);                                   \
+    } else {                                                                   \
+        for (size_t _carr_j = _carr_old; _carr_j < (h)->len; ++_carr_j) {      \
+            Name##_sift_up((h)->items, _carr_j);                               \
+        }                                                                      \
+    }                                                                          \
+} while (0)
+
+#define carr_typed_heap_pop_k(h, Name, dst, k)                                 \
+do {                                                                           \
+    size_t _carr_kk = (k);                                                     \
+    size_t _carr_k  = _carr_kk < (h)->len ? _carr_kk : (h)->len;               \
+    for (size_t _carr_j = 0; _carr_j < _carr_k; ++_carr_j) {                   \
+        carr_typed_heap_pop((h), Name, &(dst)[_carr_j]);                       \
+    }                                                                          \
+} while (0)
+
+#define CARR_HEAP_DEFINE(Name, T, higher)                                      \
+    CARR_DARY_HEAP_DEFINE(Name, T, higher, 2)
+
+#define CARR_DARY_HEAP_DEFINE(Name, T, higher, D)                              \
+static inline void Name##_sift_up(T* a, size_t i)                              \
+{                                                                              \
+    T x = a[i];                                                                \
+    while (i > 0) {                                                            \
+        size_t p = (i - 1) / (D);                                              \
+        if (!higher(x, a[p])) {                                                \
+            break;                                                             \
+        }                                                                      \
+        a[i] = a[p];                                                           \
+        i    = p;                                                              \
+    }                                                                          \
+    a[i] = x;                                                                  \
+}                                                                              \
+                                                                               \
+static inline void Name##_sift_down(T* a, size_t n, size_t i)                  \
+{                                                                              \
+    T x = a[i];                                                                \
+    for (size_t c; (c = (D) * i + 1) < n;) {                                   \
+        /* The D children are next to each other: pick the highest. */         \
+        size_t best = c;                                                       \
+        if (n - c < (D)) {                                                     \
+            /* Only the last parent can have fewer than D children. */         \
+            for (size_t k = c + 1; k < n; ++k) {                               \
+                best = higher(a[k], a[best]) ? k : best;                       \
+            }                                                                  \
+        } else {                                                               \
+            for (size_t k = 1; k < (D); ++k) {                                 \
+                best = higher(a[c + k], a[best]) ? c + k : best;               \
+            }                                                                  \
+        }                                                                      \
+        if (!higher(a[best], x)) {                                             \
+            break;                                                             \
+        }                                                                      \
+        a[i] = a[best];                                                        \
+        i    = best;                                                           \
+    }                                                                          \
+    a[i] = x;                                                                  \
+}                                                                              \
+                                                                               \
+static inline void Name##_heapfy(T* a, size_t n)                               \
+{                                                                              \
+    for (size_t i = n > 1 ? (n - 2) / (D) + 1 : 0; i-- > 0;) {                 \
+        Name##_sift_down(a, n, i);                                             \
+    }                                                                          \
+}
+
+
+/*-----------------------------------------------------------------------------+
+ *                                                                             *
+ *  CARR_ALIGNED_DARY_HEAP_DEFINE(Name, T, higher, D) generates the functions  *
+ *  of CARR_DARY_HEAP_DEFINE, and a D-ary heap of T that keeps its items so    *
+ *  that every group of children starts a cache line:                          *
+ *  typedef struct {                                                           *
+ *       T*     items                                                          *
+ *       size_t len                                                            *
+ *       size_t cap                                                            *
+ *       void*  block                                                          *
+ *  } Name;                                                                    *
+ *  with:                                                                      *
+ *      void Name##_init(Name* h)                                              *
+ *      void Name##_free(Name* h)                                              *
+ *      void Name##_reserve(Name* h, size_t n)  room for n more items          *
+ *      void Name##_push(Name* h, T item)                                      *
+ *  The items sit in a block from CARR_MALLOC, a line longer than needed, at   *
+ *  the offset that puts items[1], the first child of the root, at the start   *
+ *  of a line. The children of i start D*i items after it, so a group of D     *
+ *  children never straddles two lines when D * sizeof(T) divides the line     *
+ *  size, and a sift-down level reads a single line.                           *
+ *  items does not point to the start of block, so the vec_* macros that       *
+ *  allocate or free must not be used on it: it grows only through             *
+ *  Name##_reserve and Name##_push, and is freed with Name##_free. The         *
+ *  carr_typed_heap_* macros that never allocate (pop, pop_k, increase,        *
+ *  heapfy) work on it as usual, with Name.                                    *
+ *                                                                             *
+ +-----------------------------------------------------------------------------*/
+
+// The cache line size the aligned heaps are laid out for, a power of two.
+#ifndef CARR_HEAP_CACHE_LINE
+#define CARR_HEAP_CACHE_LINE 64
+#endif // CARR_HEAP_CACHE_LINE
+
+#define CARR_ALIGNED_DARY_HEAP_DEFINE(Name, T, higher, D)                      \
+CARR_DARY_HEAP_DEFINE(Name, T, higher, D)                                      \
+                                                                               \
+typedef struct {                                                               \
+    T*     items;                                                              \
+    size_t len;                                                                \
+    size_t cap;                                                                \
+    void*  block;                                                              \
+} Name;                                                                        \
+                                                                               \
+static inline void Name##_init(Name* h)                                        \
+{                                                                              \
+    *h = (Name){ 0 };                                                          \
+}                                                                              \
+                                                                               \
+static inline void Name##_free(Name* h)                                        \
+{                                                                              \
+    CARR_FREE(h->block);                                                       \
+    Name##_init(h);                                                            \
+}                                                                              \
+                                                                               \
+static inline void Name##_reserve(Name* h, size_t n)                           \
+{                                                                              \
+    if (h->len + n <= h->cap) {                                                \
+        return;                                                                \
+    }                                                                          \
+    size_t cap   = _carr_vec_next_cap(h->cap, h->len + n);                     \
+    char*  block = (char*)CARR_MALLOC(                                         \
+        cap * sizeof(T) + CARR_HEAP_CACHE_LINE - 1                             \
+    );                                                                         \
+    if (block == NULL) {                                                       \
+        printf(                                                                \
+            "ERROR:%s:%d Cannot allocate a heap of %zu items\n",               \
+            __FILE_NAME__, __LINE__, cap                                       \
+        );                                                                     \
+        exit(2);                                                               \
+    }                                                                          \
+    /* Rounds the address of items[1] up to the next line. */                  \
+    uintptr_t line  = CARR_HEAP_CACHE_LINE;                                    \
+    uintptr_t first = ((uintptr_t)block + sizeof(T) + line - 1) & ~(line - 1); \
+    T* items = (T*)(first - sizeof(T));                                        \
+    if (h->len > 0) {                                                          \
+        memcpy(items, h->items, h->len * sizeof(T));                           \
+    }                                                                          \
+    CARR_FREE(h->block);                                                       \
+    h->items = items;                                                          \
+    h->cap   = cap;                                                            \
+    h->block = block;                                                          \
+}                                                                              \
+                                                                               \
+static inline void Name##_push(Name* h, T item)                                \
+{                                                                              \
+    if (h->len == h->cap) {                                                    \
+        Name##_reserve(h, 1);                                                  \
+    }                                                                          \
+    h->items[h->len++] = item;                                                 \
+    Name##_sift_up(h->items, h->len - 1);                                      \
+}
+
+
+/*-----------------------------------------------------------------------------+
+ *                                                                             *
+ *  CARR_TOP_K_DEFINE(Name, T, higher) generates a bounded selection of the    *
+ *  k highest items of a stream:                                               *
+ *  typedef struct {                                                           *
+ *       T*     items                                                          *
+ *       size_t len                                                            *
+ *       size_t cap                                                            *
+ *       size_t k                                                              *
+ *  } Name;                                                                    *
+ *  with:                                                                      *
+ *      void Name##_init(Name* t, size_t k)                                    *
+ *      void Name##_free(Name* t)                                              *
+ *      bool Name##_offer(Name* t, T item)     false if item was rejected      *
+ *      void Name##_sort(Name* t)              highest first                   *
+ *  The items kept are a heap with the lowest of them on top, so an item       *
+ *  that does not make it is rejected with a single comparison, and one that   *
+ *  does replaces the top. That takes O(k) memory and O(n log k) time for a    *
+ *  stream of n items, instead of O(n) memory to heap or sort all of them.     *
+ *  After Name##_sort, items holds the selection in order, and no more items   *
+ *  can be offered.                                                            *
+ *                                                                             *
+ +-----------------------------------------------------------------------------*/
+
+#define CARR_TOP_K_DEFINE(Name, T, higher)                                     \
+typedef struct {                                                               \
+    T*     items;                                                              \
+    size_t len;                                                                \
+    size_t cap;                                                                \
+    size_t k;                                                                  \
+} Name;                                                                        \
+                                                                               \
+static inline bool Name##_lower(T a, T b)                                      \
+{                                                                              \
+    return higher(b, a);                                                       \
+}                                                                              \
+                                                                               \
+CARR_HEAP_DEFINE(Name##_kept, T, Name##_lower)                                 \
+                                                                               \
+static inline void Name##_init(Name* t, size_t k)                              \
+{                                                                              \
+    carr_vec_init(t);                                                          \
+    carr_vec_reserve(t, k);                                                    \
+    t->k = k;                                                                  \
+}                                                                              \
+                                                                               \
+static inline void Name##_free(Name* t)                                        \
+{                                                                              \
+    carr_vec_free(t);                                                          \
+    t->k = 0;                                                                  \
+}                                                                              \
+                                                                               \
+static inline bool Name##_offer(Name* t, T item)                               \
+{                                                                              \
+    if (t->len < t->k) {                                                       \
+        t->items[t->len++] = item;                                             \
+        Name##_kept_sift_up(t->items, t->len - 1);                             \
+        return true;                                                           \
+    }                                                                          \
+    if (t->len == 0 || !higher(item, t->items[0])) {                           \
+        return false;                                                          \
+    }                                                                          \
+    t->items[0] = item;                                                        \
+    Name##_kept_sift_down(t->items, t->len, 0);                                \
+    return true;                                                               \
+}                                                                              \
+                                                                               \
+static inline void Name##_sort(Name* t)                                        \
+{                                                                              \
+    /* Heap sort: the lowest goes to the back each time. */                    \
+    for (size_t n = t->len; n > 1; n--) {                                      \
+        T top           = t->items[0];                                         \
+        t->items[0]     = t->items[n - 1];                                     \
+        t->items[n - 1] = top;                                                 \
+        Name##_kept_sift_down(t->items, n - 1, 0);                             \
+    }                                                                          \
+}
+
+
+
+/*-----------------------------------------------------------------------------+
+ *                                                                             *
+ *  CARR_INDEXED_HEAP_DEFINE(Name, T, higher) generates a binary heap of T     *
+ *  whose items can be found again after they are pushed:                      *
+ *  typedef struct { T item; size_t handle; } NameNode;                        *
+ *  typedef struct {                                                           *
+ *       NameNode* items                                                       *
+ *       size_t    len                                                         *
+ *       size_t    cap                                                         *
+ *       vec of size_t pos       position of each handle in items              *
+ *       vec of size_t free      handles of popped items, to be reused         *
+ *  } Name;                                                                    *
+ *  with:                                                                      *
+ *      void   Name##_init(Name* h)                                            *
+ *      void   Name##_free(Name* h)                                            *
+ *      size_t Name##_push(Name* h, T item)          returns the handle        *
+ *      size_t Name##_pop(Name* h, T* res)           returns the handle        *
+ *      bool   Name##_contains(Name* h, size_t handle)                         *
+ *      T*     Name##_get(Name* h, size_t handle)                              *
+ *      void   Name##_increase(Name* h, size_t handle, T item)                 *
+ *      void   Name##_decrease(Name* h, size_t handle, T item)                 *
+ *      void   Name##_update(Name* h, size_t handle, T item)                   *
+ *      void   Name##_remove(Name* h, size_t handle)                           *
+ *  higher(a, b) is as in CARR_HEAP_DEFINE. increase moves an item towards     *
+ *  the top and decrease towards the bottom, so in a min heap, as the one of   *
+ *  Dijkstra's algorithm, lowering a distance is an increase. update takes     *
+ *  either way. All of them are O(log n).                                      *
+ *  A handle stays valid until its item is popped or removed, and is then      *
+ *  reused by a later push. The item behind Name##_get must not be changed     *
+ *  in place in a way that moves it, use the functions above for that.         *
+ *                                                                             *
+ +-----------------------------------------------------------------------------*/
+
+// Position of a handle that is not in the heap.
+#define CARR_HEAP_NO_POS SIZE_MAX
+
+#define CARR_INDEXED_HEAP_DEFINE(Name, T, higher)                              \
+typedef struct {                                                               \
+    T      item;                                                               \
+    size_t handle;                                                             \
+} Name##Node;                                                                  \
+                                                                               \
+typedef struct {                                                               \
+    Name##Node* items;                                                         \
+    size_t      len;                                                           \
+    size_t      cap;                                                           \
+    struct { size_t* items; size_t len; size_t cap; } pos;                     \
+    struct { size_t* items; size_t len; size_t cap; } free;                    \
+} Name;                                                                        \
+                                                                               \
+static inline void Name##_init(Name* h)                                        \
+{                                                                              \
+    carr_vec_init(h);                                                          \
+    carr_vec_init(&h->pos);                                                    \
+    carr_vec_init(&h->free);                                                   \
+}                                                                              \
+                                                                               \
+static inline void Name##_free(Name* h)                                        \
+{                                                                              \
+    carr_vec_free(h);                                                          \
+    carr_vec_free(&h->pos);                                                    \
+    carr_vec_free(&h->free);                                                   \
+}                                                                              \
+                                                                               \
+static inline void Name##_sift_up(Name* h, size_t i)                           \
+{                                                                              \
+    Name##Node x = h->items[i];                                                \
+    while (i > 0) {                                                            \
+        size_t p = carr_heap_parent(i);                                        \
+        if (!higher(x.item, h->items[p].item)) {                               \
+            break;                                                             \
+        }                                                                      \
+        h->items[i] = h->items[p];                                             \
+        h->pos.items[h->items[i].handle] = i;                                  \
+        i = p;                                                                 \
+    }                                                                          \
+    h->items[i] = x;                                                           \
+    h->pos.items[x.handle] = i;                                                \
+}                                                                              \
+                                                                               \
+static inline void Name##_sift_down(Name* h, size_t i)                         \
+{                                                                              \
+    Name##Node x = h->items[i];                                                \
+    for (size_t c; (c = carr_heap_left(i)) < h->len;) {                        \
+        if (c + 1 < h->len && higher(h->items[c + 1].item, h->items[c].item)) {\
+            c++;                                                               \
+        }                                                                      \
+        if (!higher(h->items[c].item, x.item)) {                               \
+            break;                                                             \
+        }                                                                      \
+        h->items[i] = h->items[c];                                             \
+        h->pos.items[h->items[i].handle] = i;                                  \
+        i = c;                                                                 \
+    }                                                                          \
+    h->items[i] = x;                                                           \
+    h->pos.items[x.handle] = i;                                                \
+}                                                                              \
+                                                                               \
+static inline size_t Name##_push(Name* h, T item)                              \
+{                                                                              \
+    size_t handle;                                                             \
+    if (h->free.len > 0) {                                                     \
+        carr_vec_pop(&h->free, &handle);                                       \
+    } else {                                                                   \
+        handle = h->pos.len;                                                   \
+        carr_vec_append(&h->pos, CARR_HEAP_NO_POS);                            \
+    }                                                                          \
+    Name##Node node = { .item = item, .handle = handle };                      \
+    carr_vec_append(h, node);                                                  \
+    Name##_sift_up(h, h->len - 1);                                             \
+    return handle;                                                             \
+}                                                                              \
+                                                                               \
+static inline bool Name##_contains(Name* h, size_t handle)                     \
+{                                                                              \
+    return handle < h->pos.len && h->pos.items[handle] != CARR_HEAP_NO_POS;    \
+}                                                                              \
+                                                                               \
+static inline T* Name##_get(Name* h, size_t handle)                            \
+{                                                                              \
+    assert(Name##_contains(h, handle));                                        \
+    return &h->items[h->pos.items[handle]].item;                               \
+}                                                                              \
+                                                                               \
+/* Takes the item at position i out, putting the last one in its place. */     \
+static inline void Name##_take(Name* h, size_t i)                              \
+{                                                                              \
+    size_t handle = h->items[i].handle;                                        \
+    h->pos.items[handle] = CARR_HEAP_NO_POS;                                   \
+    carr_vec_append(&h->free, handle);                                         \
+    h->len--;                                                                  \
+    if (i == h->len) {                                                         \
+        return;                                                                \
+    }                                                                          \
+    h->items[i] = h->items[h->len];                                            \
+    T item = h->items[i].item;                                                 \
+    if (i > 0 && higher(item, h->items[carr_heap_parent(i)].item)) {           \
+        Name##_sift_up(h, i);                                                  \
+    } else {                                                                   \
+        Name##_sift_down(h, i);                                                \
+    }                                                                          \
+}                                                                              \
+                                                                               \
+static inline size_t Name##_pop(Name* h, T* res)                               \
+{                                                                              \
+    if (h->len == 0) {                                                         \
+        printf(                                                                \
+            "ERROR:%s:%d Cannot pop item out of an empty heap\n",              \
+            __FILE_NAME__, __LINE__                                            \
+        );                                                                     \
+        exit(2);                                                               \
+    }                                                                          \
+    size_t handle = h->items[0].handle;                                        \
+    *res = h->items[0].item;                                                   \
+    Name##_take(h, 0);                                                         \
+    return handle;                                                             \
+}                                                                              \
+                                                                               \
+static inline void Name##_remove(Name* h, size_t handle)                       \
+{                                                                              \
+    assert(Name##_contains(h, handle));                                        \
+    Name##_take(h, h->pos.items[handle]);                                      \
+}                                                                              \
+                                                                               \
+static inline void Name##_increase(Name* h, size_t handle, T item)             \
+{                                                                              \
+    assert(Name##_contains(h, handle));                                        \
+    size_t i = h->pos.items[handle];                                           \
+    h->items[i].item = item;                                                   \
+    Name##_sift_up(h, i);                                                      \
+}                                                                              \
+                                                                               \
+static inline void Name##_decrease(Name* h, size_t handle, T item)             \
+{                                                                              \
+    assert(Name##_contains(h, handle));                                        \
+    size_t i = h->pos.items[handle];                                           \
+    h->items[i].item = item;                                                   \
+    Name##_sift_down(h, i);                                                    \
+}                                                                              \
+                                                                               \
+static inline void Name##_update(Name* h, size_t handle, T item)               \
+{                                                                              \
+    assert(Name##_contains(h, handle));                                        \
+    size_t i = h->pos.items[handle];                                           \
+    h->items[i].item = item;                                                   \
+    if (i > 0 && higher(item, h->items[carr_heap_parent(i)].item)) {           \
+        Name##_sift_up(h, i);                                                  \
+    } else {                                                                   \
+        Name##_sift_down(h, i);                                                \
+    }                                                                          \
+}
+
+
+
+/*-----------------------------------------------------------------------------+
+ *                                                                             *
+ *  CARR_RADIX_HEAP_DEFINE(Name, T, key) generates a min heap of T for keys    *
+ *  that never go below the last one popped, as timestamps or the distances    *
+ *  of Dijkstra's algorithm:                                                   *
+ *      void Name##_init(Name* h)                                              *
+ *      void Name##_free(Name* h)                                              *
+ *      void Name##_push(Name* h, T item)                                      *
+ *      void Name##_pop(Name* h, T* res)                                       *
+ *      T*   Name##_top(Name* h)                                               *
+ *  key(item) is a uint64_t, as in CARR_VEC_RADIX_SORT_DEFINE. Pushing an      *
+ *  item whose key is below the last popped one is an error.                   *
+ *  The items are kept in 65 buckets, by the highest bit where their key       *
+ *  differs from the last popped one: bucket 0 holds the keys equal to it      *
+ *  and bucket b the ones that differ first at bit b - 1. A push appends to    *
+ *  a bucket, without comparisons. A pop takes from bucket 0 and, when it is   *
+ *  empty, refills it from the first bucket that is not: the minimum of that   *
+ *  bucket becomes the last key, and its items all move to lower buckets.      *
+ *  Each item can only move down, at most 64 times, so a pop is amortized      *
+ *  O(log C) for keys spanning a range of C, whatever the number of items.     *
+ *  Items with equal keys are popped in no particular order.                   *
+ *                                                                             *
+ +-----------------------------------------------------------------------------*/
+
+#define CARR_RADIX_HEAP_BUCKETS 65
+
+#define CARR_RADIX_HEAP_DEFINE(Name, T, key)                                   \
+typedef struct {                                                               \
+    struct { T* items; size_t len; size_t cap; } buckets[                      \
+        CARR_RADIX_HEAP_BUCKETS                                                \
+    ];                                                                         \
+    uint64_t last;                                                             \
+    /* Bit b - 1 is set when bucket b is not empty. */                         \
+    uint64_t used;                                                             \
+    size_t   len;                                                              \
+} Name;                                                                        \
+                                                                               \
+static inline void Name##_init(Name* h)                                        \
+{                                                                              \
+    for (size_t b = 0; b < CARR_RADIX_HEAP_BUCKETS; ++b) {                     \
+        carr_vec_init(&h->buckets[b]);                                         \
+    }                                                                          \
+    h->last = 0;                                                               \
+    h->used = 0;                                                               \
+    h->len  = 0;                                                               \
+}                                                                              \
+                                                                               \
+static inline void Name##_free(Name* h)                                        \
+{                                                                              \
+    for (size_t b = 0; b < CARR_RADIX_HEAP_BUCKETS; ++b) {                     \
+        carr_vec_free(&h->buckets[b]);                                         \
+    }                                                                          \
+    Name##_init(h);                                                            \
+}                                                                              \
+                                                                               \
+static inline void Name##_put(Name* h, T item, uint64_t k)                     \
+{                                                                              \
+    size_t b = k == h->last ? 0 : 64 - __builtin_clzll(k ^ h->last);           \
+    carr_vec_append(&h->buckets[b], item);                                     \
+    if (b > 0) {                                                               \
+        h->used |= 1ull << (b - 1);                                            \
+    }                                                                          \
+}                                                                              \
+                                                                               \
+static inline void Name##_push(Name* h, T item)                                \
+{                                                                              \
+    uint64_t k = key(item);                                                    \
+    if (k < h->last) {                                                         \
+        printf(                                                                \
+            "ERROR:%s:%d Cannot push key %llu below the last popped %llu\n",   \
+            __FILE_NAME__, __LINE__,                                           \
+            (unsigned long long)k, (unsigned long long)h->last                 \
+        );                                                                     \
+        exit(2);                                                               \
+    }                                                                          \
+    Name##_put(h, item, k);                                                    \
+    h->len++;                                                                  \
+}                                                                              \
+                                                                               \
+/* Makes sure bucket 0 has the items with the minimum key. */                  \
+static inline void Name##_refill(Name* h)                                      \
+{                                                                              \
+    if (h->buckets[0].len > 0 || h->len == 0) {                                \
+        return;                                                                \
+    }                                                                          \
+    size_t b    = (size_t)__builtin_ctzll(h->used) + 1;                        \
+    T*     from = h->buckets[b].items;                                         \
+    size_t n    = h->buckets[b].len;                                           \
+                                                                               \
+    uint64_t min = key(from[0]);                                               \
+    for (size_t i = 1; i < n; ++i) {                                           \
+        uint64_t k = key(from[i]);                                             \
+        min = k < min ? k : min;                                               \
+    }                                                                          \
+    h->last = min;                                                             \
+    h->buckets[b].len = 0;                                                     \
+    h->used &= ~(1ull << (b - 1));                                             \
+    /* Relative to the new last key, they all land below bucket b. */          \
+    for (size_t i = 0; i < n; ++i) {                                           \
+        Name##_put(h, from[i], key(from[i]));                                  \
+    }                                                                          \
+}                                                                              \
+                                                                               \
+static inline T* Name##_top(Name* h)                                           \
+{                                                                              \
+    Name##_refill(h);                                                          \
+    if (h->len == 0) {                                                         \
+        return NULL;                                                           \
+    }                                                                          \
+    return &h->buckets[0].items[h->buckets[0].len - 1];                        \
+}                                                                              \
+                                                                               \
+static inline void Name##_pop(Name* h, T* res)                                 \
+{                                                                              \
+    Name##_refill(h);                                                          \
+    carr_vec_pop(&h->buckets[0], res);                                         \
+    h->len--;                                                                  \
+}
 
 
 